@@ -84,6 +84,8 @@ consoleread(int user_dst, uint64 dst, int n)
   char cbuf;
 
   target = n;
+  if(user_dst)
+    uvmprefault(dst, n);
   acquire(&cons.lock);
   while(n > 0){
     // wait until interrupt handler has put some
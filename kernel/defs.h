@@ -1,5 +1,6 @@
 struct buf;
 struct context;
+struct execseg;
 struct file;
 struct inode;
 struct pipe;
@@ -8,6 +9,7 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct vma;
 
 // bio.c
 void            binit(void);
@@ -24,6 +26,8 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+struct execseg* execseg(struct proc*, uint64);
+int             execfault(struct proc*, struct execseg*, uint64);
 
 // file.c
 struct file*    filealloc(void);
@@ -33,6 +37,7 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filewriteback(struct file*, char*, uint, int);
 
 // fs.c
 void            fsinit(int);
@@ -62,6 +67,8 @@ void            ramdiskrw(struct buf*);
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
+void            kref(void *);
+int             krefs(void *);
 void            kinit(void);
 
 // log.c
@@ -70,6 +77,19 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// mmap.c
+struct vma*     vmalookup(struct proc*, uint64);
+uint64          vmabase(struct proc*);
+int             vmafault(struct proc*, struct vma*, uint64, int);
+void            munmapall(struct proc*);
+int             vmacopy(struct proc*, struct proc*);
+
+// pcache.c
+void            pcinit(void);
+char*           pcget(struct inode*, uint, int);
+void            pcinval(struct inode*, int);
+void            pcupdate(struct inode*, uint, char*, uint);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -86,10 +106,16 @@ int             cpuid(void);
 void            exit(int);
 int             fork(void);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+struct proc*    findproc(int);
+void            group_refill(void);
+uint64          group_next(void);
+void            gang_rotate(void);
+uint64          gang_next(void);
+void            dl_replenish(void);
+uint64          dl_next(void);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -98,12 +124,17 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
-int             wait(uint64);
+int             wait(uint64, uint64);
 void            wakeup(void*);
 void            yield(void);
+void            preempt(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+void            ipi(int);
+void            boost_if_due(void);
+extern uint64   nextboost;
+int             quantum_expired(void);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -115,6 +146,7 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+void            lockbenchinit(void);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -141,10 +173,13 @@ void            syscall();
 
 // trap.c
 extern uint     ticks;
+extern int      tickwaiters;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+uint64          mtime(void);
+void            timerset(void);
 
 // uart.c
 void            uartinit(void);
@@ -163,6 +198,11 @@ void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcopyrange(pagetable_t, pagetable_t, uint64, uint64, int);
+int             uvmcow(pagetable_t, uint64);
+int             uvmlazy(pagetable_t, uint64, uint64);
+int             uvmfault(struct proc*, uint64, int);
+void            uvmprefault(uint64, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
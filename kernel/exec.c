@@ -6,8 +6,9 @@
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
-
-static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
 int
 exec(char *path, char **argv)
@@ -16,8 +17,10 @@ exec(char *path, char **argv)
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe = 0, *oldexe;
   struct proghdr ph;
+  struct execseg segs[MAXSEG];
+  int nsegs = 0;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
@@ -38,7 +41,9 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Note where the program's segments are. Nothing is read or
+  // allocated yet: execfault() maps their pages as they are touched,
+  // and their zeroed tails are heap pages to uvmlazy().
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -48,15 +53,23 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
-      goto bad;
-    sz = sz1;
     if((ph.vaddr % PGSIZE) != 0)
       goto bad;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    // segments may not share pages, since each page is mapped
+    // from one of them.
+    if(ph.vaddr < PGROUNDUP(sz) || ph.vaddr + ph.memsz > TRAPFRAME)
+      goto bad;
+    if(ph.off + ph.filesz < ph.off || ph.off + ph.filesz > ip->size)
       goto bad;
+    if(nsegs == MAXSEG)
+      goto bad;
+    segs[nsegs].va = ph.vaddr;
+    segs[nsegs].end = ph.vaddr + ph.filesz;
+    segs[nsegs].off = ph.off;
+    nsegs++;
+    sz = ph.vaddr + ph.memsz;
   }
+  exe = idup(ip);
   iunlockput(ip);
   end_op();
   ip = 0;
@@ -109,13 +122,23 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
-  // Commit to the user image.
+  // Commit to the user image. mmap()ed regions don't survive it.
+  munmapall(p);
   oldpagetable = p->pagetable;
+  oldexe = p->exe;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->exe = exe;
+  memmove(p->segs, segs, sizeof(segs));
+  p->nsegs = nsegs;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  if(oldexe){
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -126,30 +149,71 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    begin_op();
+    iput(exe);
+    end_op();
+  }
   return -1;
 }
 
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
+// Find the program segment whose file data holds va.
+// Returns 0 if va is not in one.
+struct execseg*
+execseg(struct proc *p, uint64 va)
+{
+  struct execseg *s;
+
+  for(s = p->segs; s < &p->segs[p->nsegs]; s++)
+    if(va >= s->va && va < s->end)
+      return s;
+  return 0;
+}
+
+// Map the page at va of a program segment, on its first touch.
+// A page that is all file data comes from the program page cache and
+// is shared, read-only and PTE_COW, with every process running the
+// program. The page where the file data ends is read into a page of
+// its own, since the rest of it must be zero.
+// Returns 0 on success, -1 if the page is already mapped, there is
+// no memory, or the file can't be read.
+int
+execfault(struct proc *p, struct execseg *s, uint64 va)
 {
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
+  pte_t *pte;
+  char *mem;
+  uint off, n;
+  int perm, locked;
+
+  va = PGROUNDDOWN(va);
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V))
+    return -1;
+  off = s->off + (va - s->va);
+  n = s->end - va < PGSIZE ? s->end - va : PGSIZE;
+  if(n == PGSIZE){
+    if((mem = pcget(p->exe, off, 0)) == 0)
+      return -1;
+    perm = PTE_R | PTE_X | PTE_U | PTE_COW;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    // the process may be reading its own program file.
+    if((locked = holdingsleep(&p->exe->lock)) == 0)
+      ilock(p->exe);
+    if(readi(p->exe, 0, (uint64)mem, off, n) != n){
+      if(!locked)
+        iunlock(p->exe);
+      kfree(mem);
       return -1;
+    }
+    if(!locked)
+      iunlock(p->exe);
+    perm = PTE_R | PTE_W | PTE_X | PTE_U;
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return -1;
   }
-  
   return 0;
 }
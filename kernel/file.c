@@ -118,6 +118,10 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
+    // the copy can't read in a file page with f->ip locked. the
+    // size is only a hint of how much will be copied.
+    uint left = f->off < f->ip->size ? f->ip->size - f->off : 0;
+    uvmprefault(addr, (uint)n < left ? n : left);
     ilock(f->ip);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
@@ -154,6 +158,8 @@ filewrite(struct file *f, uint64 addr, int n)
     // might be writing a device like the console.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
     int i = 0;
+    // the copy can't read in a file page with f->ip locked.
+    uvmprefault(addr, n);
     while(i < n){
       int n1 = n - i;
       if(n1 > max)
@@ -180,3 +186,38 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+// Write n bytes of kernel memory at src to file f at offset off,
+// but not past the end of the file, a few blocks per transaction
+// like filewrite(). For writing MAP_SHARED pages back; f->off
+// doesn't move.
+// Returns the number of bytes written, or -1 on error.
+int
+filewriteback(struct file *f, char *src, uint off, int n)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  int i = 0, r = 0;
+
+  if(f->type != FD_INODE)
+    return -1;
+  while(i < n){
+    int n1 = n - i;
+    if(n1 > max)
+      n1 = max;
+
+    begin_op();
+    ilock(f->ip);
+    if(off + i >= f->ip->size)
+      n1 = 0;
+    else if(off + i + n1 > f->ip->size)
+      n1 = f->ip->size - (off + i);
+    if(n1 > 0)
+      r = writei(f->ip, 0, (uint64)src + i, off + i, n1);
+    iunlock(f->ip);
+    end_op();
+
+    if(n1 == 0 || r != n1)
+      break;
+    i += r;
+  }
+  return r < 0 ? -1 : i;
+}
@@ -18,15 +18,38 @@ struct run {
   struct run *next;
 };
 
+// how many page tables map each physical page. fork() shares a
+// process's pages with its child instead of copying them, and a
+// page is only freed once the last mapping of it is gone.
+// updated with atomic adds, so it needs no lock.
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+int refcnt[(PHYSTOP - KERNBASE) / PGSIZE];
+
+// the shared pool of free pages.
 struct {
   struct spinlock lock;
   struct run *freelist;
 } kmem;
 
+// each cpu keeps its own cache of free pages, so that most
+// kalloc()s and kfree()s take only that cpu's lock, which other
+// harts only take to steal pages when they run dry. pages move
+// between a cache and the pool KBATCH at a time.
+#define KBATCH 32    // pages moved to or from the pool at once
+#define KHIGH  (2*KBATCH) // most pages a cache holds before giving some back
+
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;             // pages on freelist
+} kcache[NCPU];
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,31 +58,127 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    refcnt[PA2REF(p)] = 1;
     kfree(p);
+  }
+}
+
+// unlink the first n pages of a list, which must have at least n.
+// returns the last of them; *list is left pointing at the rest.
+static struct run*
+takepages(struct run **list, struct run **first, int n)
+{
+  struct run *last = *list;
+
+  for(int i = 1; i < n; i++)
+    last = last->next;
+  *first = *list;
+  *list = last->next;
+  last->next = 0;
+  return last;
+}
+
+// give KBATCH pages from a full cache back to the pool.
+// caller must hold kc->lock.
+static void
+drain(struct kcache *kc)
+{
+  struct run *first, *last;
+
+  last = takepages(&kc->freelist, &first, KBATCH);
+  kc->n -= KBATCH;
+  acquire(&kmem.lock);
+  last->next = kmem.freelist;
+  kmem.freelist = first;
+  release(&kmem.lock);
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// fill an empty cache with up to KBATCH pages from the pool.
+// caller must hold kc->lock.
+static void
+refill(struct kcache *kc)
+{
+  struct run *r;
+  int n = 0;
+
+  acquire(&kmem.lock);
+  for(r = kmem.freelist; r && n < KBATCH; r = r->next)
+    n++;
+  if(n)
+    takepages(&kmem.freelist, &kc->freelist, n);
+  release(&kmem.lock);
+  kc->n = n;
+}
+
+// take half the pages of another cpu's cache, for a cpu whose
+// cache and the pool are both empty. keeps one page and puts the
+// rest in this cpu's cache. interrupts must be off.
+static struct run*
+steal(struct kcache *kc)
+{
+  struct kcache *victim;
+  struct run *first = 0, *last = 0;
+  int n = 0;
+
+  // n and freelist of another cpu are only hints until its lock is held.
+  for(victim = kcache; victim < &kcache[NCPU] && n == 0; victim++){
+    if(victim == kc || victim->n == 0)
+      continue;
+    acquire(&victim->lock);
+    if(victim->n > 0){
+      n = (victim->n + 1) / 2;
+      last = takepages(&victim->freelist, &first, n);
+      victim->n -= n;
+    }
+    release(&victim->lock);
+  }
+  // this cpu's lock isn't held while taking another's, so two
+  // harts stealing from each other can't deadlock.
+  if(n > 1){
+    acquire(&kc->lock);
+    last->next = kc->freelist;
+    kc->freelist = first->next;
+    kc->n += n - 1;
+    release(&kc->lock);
+  }
+  return first;
+}
+
+// Drop a reference to the page of physical memory pointed at
+// by pa, and free it if that was the last one. The page normally
+// should have been returned by a call to kalloc().  (The exception
+// is when initializing the allocator; see kinit above.)
 void
 kfree(void *pa)
 {
   struct run *r;
+  struct kcache *kc;
+  int n;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if((n = __sync_sub_and_fetch(&refcnt[PA2REF(pa)], 1)) > 0)
+    return;
+  if(n < 0)
+    panic("kfree: not allocated");
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  // stay on this cpu while using its cache.
+  push_off();
+  kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  if(++kc->n >= KHIGH)
+    drain(kc);
+  release(&kc->lock);
+  pop_off();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -69,14 +188,43 @@ void *
 kalloc(void)
 {
   struct run *r;
+  struct kcache *kc;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  kc = &kcache[cpuid()];
+  acquire(&kc->lock);
+  if(kc->freelist == 0)
+    refill(kc);
+  r = kc->freelist;
+  if(r){
+    kc->freelist = r->next;
+    kc->n--;
+  }
+  release(&kc->lock);
+  if(r == 0)
+    r = steal(kc);
+  pop_off();
 
-  if(r)
+  if(r){
     memset((char*)r, 5, PGSIZE); // fill with junk
+    refcnt[PA2REF(r)] = 1;
+  }
   return (void*)r;
 }
+
+// Add a reference to an allocated page, which is now mapped
+// in one more place.
+void
+kref(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kref");
+  __sync_fetch_and_add(&refcnt[PA2REF(pa)], 1);
+}
+
+// How many references there are to an allocated page.
+int
+krefs(void *pa)
+{
+  return refcnt[PA2REF(pa)];
+}
@@ -0,0 +1,13 @@
+#define LOCKNAME 16  // longest lock name getlockstat() reports
+
+// statistics of all the spinlocks with one name, from getlockstat().
+// times are in CLINT mtime cycles; see MTIMEHZ.
+struct lockstat {
+  char name[LOCKNAME];
+  uint64 nlocks;      // locks initialized with this name
+  uint64 nacquire;    // acquisitions
+  uint64 ncontended;  // acquisitions that found the lock held
+  uint64 spin;        // cycles spent spinning for the lock
+  uint64 hold;        // cycles the lock was held
+  uint64 maxhold;     // longest time any of the locks was held
+};
@@ -1,10 +1,26 @@
-//Log entry struct. Copied from project doc
-#define LOG_SIZE 100 
+//Scheduling event log. Each cpu writes its own ring of LOG_SIZE
+//entries, overwriting the oldest ones once it wraps.
+#define LOG_SIZE 256 // entries per cpu; must be a power of 2
 
-//Global clock. Copied from announcement
-extern int time;
+//Scheduling event types
+#define LOG_DISPATCH 1 // scheduler switched to the process
+#define LOG_PREEMPT  2 // process gave up the cpu at the end of its quantum
+#define LOG_SLEEP    3 // process went to sleep
+#define LOG_WAKE     4 // process was woken up
+#define LOG_BOOST    5 // process moved up a level
+#define LOG_DEMOTE   6 // process moved down a level
+#define LOG_DLMISS   7 // deadline class process ran past its deadline
+
+//Number of log2 buckets in each scheduling latency histogram.
+//Bucket b counts waits of [2^b, 2^(b+1)) cycles; bucket 0 also counts 0.
+#define LAT_BUCKETS 32
+//Most MLFQ levels getlat() will report.
+#define LAT_LEVELS 32
 
 struct logentry { 
+        uint64 time; // CLINT_MTIME cycles since boot
+        int cpu; // cpu that recorded the event
         int pid; // process id 
-        int time; // number of ticks 
-};
\ No newline at end of file
+        int queue; // MLFQ level of the process after the event
+        int event; // one of the LOG_ event types
+};
@@ -20,11 +20,13 @@ main()
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
+    lockbenchinit(); // lock microbenchmark
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
+    pcinit();        // program page cache
     iinit();         // inode table
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
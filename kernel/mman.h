@@ -0,0 +1,10 @@
+// mmap() protections; a mapping with none can't be touched.
+#define PROT_NONE     0x0
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+#define PROT_EXEC     0x4
+
+// mmap() flags. exactly one of MAP_SHARED and MAP_PRIVATE.
+#define MAP_SHARED    0x01  // stores reach the file and other sharers
+#define MAP_PRIVATE   0x02  // stores go to copies of the process's own
+#define MAP_ANONYMOUS 0x20  // zeroed memory rather than a file; fd is ignored
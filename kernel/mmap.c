@@ -0,0 +1,329 @@
+// Memory-mapped files and anonymous memory.
+//
+// mmap() only notes a region in the process's vmas[]; vmafault()
+// maps each page on its first touch. File pages come from the
+// program page cache, so no copy is made: MAP_PRIVATE mappings of a
+// file map the same read-only pages as exec(), and its MAP_SHARED
+// mappings all map the same pages of their own, which the cache keeps
+// while they are mapped. A MAP_PRIVATE page is mapped PTE_COW if it
+// may be written. A MAP_SHARED page is mapped read-only until the first store,
+// which sets PTE_DIRTY, so that munmap() and exit() only write back
+// the pages that were written, through the log. Anonymous pages are
+// zeroed on first touch, except that fork() first maps every page of
+// an anonymous MAP_SHARED mapping, so that there is one page for the
+// parent and child to share.
+//
+// Mappings are placed top down from the trapframe, and the heap
+// may not grow into them.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "mman.h"
+
+// Find the mapping that holds va, or 0.
+struct vma*
+vmalookup(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vmas; v < &p->vmas[NVMA]; v++)
+    if(v->addr && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// The lowest address of any mapping, which the heap can't grow past.
+uint64
+vmabase(struct proc *p)
+{
+  uint64 base = TRAPFRAME;
+
+  for(struct vma *v = p->vmas; v < &p->vmas[NVMA]; v++)
+    if(v->addr && v->addr < base)
+      base = v->addr;
+  return base;
+}
+
+// Map the page at va of a mapping on its first touch, or let a
+// MAP_SHARED page be written and mark it dirty on the first store.
+// Returns 0 on success, -1 if the access isn't allowed or the
+// page can't be mapped.
+int
+vmafault(struct proc *p, struct vma *v, uint64 va, int write)
+{
+  pte_t *pte;
+  char *mem;
+  int perm;
+
+  va = PGROUNDDOWN(va);
+  if(v->prot == PROT_NONE || (write && (v->prot & PROT_WRITE) == 0))
+    return -1;
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V)){
+    if(write && (v->flags & MAP_SHARED) && (*pte & PTE_W) == 0){
+      *pte |= PTE_W | PTE_DIRTY;
+      return 0;
+    }
+    return -1;
+  }
+
+  // RISC-V has no write-only pages.
+  perm = PTE_U | PTE_R;
+  if(v->prot & PROT_EXEC)
+    perm |= PTE_X;
+  if(v->f == 0){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(v->prot & PROT_WRITE)
+      perm |= PTE_W;
+  } else {
+    // a page past the end of the file has nothing to map.
+    if((mem = pcget(v->f->ip, v->off + (va - v->addr), (v->flags & MAP_SHARED) != 0)) == 0)
+      return -1;
+    if(v->flags & MAP_SHARED){
+      if(write)
+        perm |= PTE_W | PTE_DIRTY;
+    } else if(v->prot & PROT_WRITE){
+      perm |= PTE_COW;
+    }
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Write the dirty pages of a MAP_SHARED file mapping in
+// [start, end) back to the file.
+static void
+vmawriteback(struct proc *p, struct vma *v, uint64 start, uint64 end)
+{
+  pte_t *pte;
+
+  if(v->f == 0 || (v->flags & MAP_SHARED) == 0)
+    return;
+  for(uint64 a = start; a < end; a += PGSIZE){
+    if((pte = walk(p->pagetable, a, 0)) == 0 || (*pte & PTE_DIRTY) == 0)
+      continue;
+    filewriteback(v->f, (char*)PTE2PA(*pte), v->off + (a - v->addr), PGSIZE);
+    *pte &= ~PTE_DIRTY;
+  }
+}
+
+// Write back and unmap [start, end) of a mapping. The caller
+// shrinks or frees the vma.
+static void
+vmaunmap(struct proc *p, struct vma *v, uint64 start, uint64 end)
+{
+  vmawriteback(p, v, start, end);
+  uvmunmap(p->pagetable, start, (end - start) / PGSIZE, 1);
+}
+
+// Unmap every mapping of a process that is exiting or exec()ing.
+void
+munmapall(struct proc *p)
+{
+  for(struct vma *v = p->vmas; v < &p->vmas[NVMA]; v++){
+    if(v->addr == 0)
+      continue;
+    vmaunmap(p, v, v->addr, v->addr + v->len);
+    if(v->f)
+      fileclose(v->f);
+    v->addr = 0;
+  }
+}
+
+// Map the pages of an anonymous MAP_SHARED mapping that haven't
+// been touched yet. Otherwise a parent and its child of fork() would
+// each get a private zeroed page on their own first touch.
+// Returns 0 on success, -1 if out of memory.
+static int
+vmapopulate(struct proc *p, struct vma *v)
+{
+  pte_t *pte;
+
+  if(v->f || (v->flags & MAP_SHARED) == 0 || v->prot == PROT_NONE)
+    return 0;
+  for(uint64 a = v->addr; a < v->addr + v->len; a += PGSIZE){
+    if((pte = walk(p->pagetable, a, 0)) != 0 && (*pte & PTE_V))
+      continue;
+    if(vmafault(p, v, a, 0) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Give a child of fork() the same mappings. Pages of MAP_SHARED
+// mappings are shared outright, and those of MAP_PRIVATE ones
+// copy-on-write like the rest of its memory.
+// Returns 0 on success, -1 with nothing mapped on failure.
+int
+vmacopy(struct proc *p, struct proc *np)
+{
+  struct vma *v, *nv;
+
+  for(v = p->vmas, nv = np->vmas; v < &p->vmas[NVMA]; v++, nv++){
+    if(v->addr == 0)
+      continue;
+    if(vmapopulate(p, v) < 0 ||
+       uvmcopyrange(p->pagetable, np->pagetable, v->addr, v->addr + v->len,
+                    v->flags & MAP_SHARED) < 0){
+      for(nv = np->vmas; nv < &np->vmas[NVMA]; nv++){
+        if(nv->addr == 0)
+          continue;
+        uvmunmap(np->pagetable, nv->addr, nv->len / PGSIZE, 1);
+        if(nv->f)
+          fileclose(nv->f);
+        nv->addr = 0;
+      }
+      return -1;
+    }
+    *nv = *v;
+    if(nv->f)
+      filedup(nv->f);
+  }
+  return 0;
+}
+
+// the highest free range of len bytes between the heap
+// and the trapframe, or 0 if there is none.
+static uint64
+vmaplace(struct proc *p, uint64 len)
+{
+  uint64 best = 0, top, start;
+  struct vma *v, *w;
+
+  // a free range ends at the trapframe or where a mapping starts.
+  for(v = p->vmas; v <= &p->vmas[NVMA]; v++){
+    if(v < &p->vmas[NVMA] && v->addr == 0)
+      continue;
+    top = v < &p->vmas[NVMA] ? v->addr : TRAPFRAME;
+    if(top < len || (start = top - len) < PGROUNDUP(p->sz) || start <= best)
+      continue;
+    for(w = p->vmas; w < &p->vmas[NVMA]; w++)
+      if(w->addr && w->addr < top && w->addr + w->len > start)
+        break;
+    if(w == &p->vmas[NVMA])
+      best = start;
+  }
+  return best;
+}
+
+// map a file or zeroed memory into the caller's address space.
+// the kernel picks the address; addr is ignored.
+// mmap(void *addr, uint64 len, int prot, int flags, int fd, uint64 off)
+// returns the address, or -1 on error.
+uint64
+sys_mmap(void)
+{
+  uint64 addr, len, off;
+  int prot, flags, fd;
+  struct file *f = 0;
+  struct proc *p = myproc();
+  struct vma *v, *free = 0;
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(4, &fd) < 0 || argaddr(5, &off) < 0)
+    return -1;
+  if(len == 0 || len > TRAPFRAME || (off % PGSIZE) != 0)
+    return -1;
+  if((prot & ~(PROT_READ|PROT_WRITE|PROT_EXEC)) != 0)
+    return -1;
+  if((flags & ~(MAP_SHARED|MAP_PRIVATE|MAP_ANONYMOUS)) != 0)
+    return -1;
+  if(((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+    return -1;
+  len = PGROUNDUP(len);
+  if((flags & MAP_ANONYMOUS) == 0){
+    if(fd < 0 || fd >= NOFILE || (f = p->ofile[fd]) == 0 || f->type != FD_INODE)
+      return -1;
+    if(!f->readable || off + len > 0x100000000ULL)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+  } else {
+    off = 0;
+  }
+
+  for(v = p->vmas; v < &p->vmas[NVMA]; v++)
+    if(v->addr == 0 && free == 0)
+      free = v;
+  if(free == 0 || (addr = vmaplace(p, len)) == 0)
+    return -1;
+  free->addr = addr;
+  free->len = len;
+  free->prot = prot;
+  free->flags = flags;
+  free->f = f ? filedup(f) : 0;
+  free->off = off;
+  return addr;
+}
+
+// unmap the pages of [addr, addr+len) that are mapped by mmap(),
+// writing dirty MAP_SHARED pages back to their files first.
+// a mapping may be cut in two.
+// munmap(void *addr, uint64 len)
+// returns 0 on success, -1 on error.
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len, start, end;
+  struct proc *p = myproc();
+  struct vma *v, *free = 0, *split = 0;
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0)
+    return -1;
+  if((addr % PGSIZE) != 0 || len == 0 || addr + len < addr)
+    return -1;
+  len = PGROUNDUP(len);
+
+  // cutting a hole in a mapping takes another slot; find it first,
+  // so that nothing changes if there is none.
+  for(v = p->vmas; v < &p->vmas[NVMA]; v++){
+    if(v->addr == 0 && free == 0)
+      free = v;
+    if(v->addr && addr > v->addr && addr + len < v->addr + v->len)
+      split = v;
+  }
+  if(split && free == 0)
+    return -1;
+
+  for(v = p->vmas; v < &p->vmas[NVMA]; v++){
+    if(v->addr == 0 || v == free)
+      continue;
+    start = addr > v->addr ? addr : v->addr;
+    end = addr + len < v->addr + v->len ? addr + len : v->addr + v->len;
+    if(start >= end)
+      continue;
+    vmaunmap(p, v, start, end);
+    if(v == split){
+      *free = *v;
+      free->addr = end;
+      free->len = v->addr + v->len - end;
+      free->off += end - v->addr;
+      if(free->f)
+        filedup(free->f);
+      v->len = start - v->addr;
+    } else if(start == v->addr && end == v->addr + v->len){
+      if(v->f)
+        fileclose(v->f);
+      v->addr = 0;
+    } else if(start == v->addr){
+      v->off += end - v->addr;
+      v->len -= end - v->addr;
+      v->addr = end;
+    } else {
+      v->len = start - v->addr;
+    }
+  }
+  return 0;
+}
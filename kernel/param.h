@@ -1,13 +1,25 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      4096  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
+#define ALLCPUS      ((1UL << NCPU) - 1)  // affinity mask of every CPU
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define MAXSEG        4  // max loadable segments in a program
+#define NVMA         16  // mmap()ed regions per process
+#define NPCACHE     512  // pages of program files kept in memory
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define TICKINTERVAL 1000000  // cycles per clock tick; about 1/10th second in qemu
+#define MTIMEHZ      10000000 // CLINT mtime cycles per second in qemu
+#define BOOSTPERIOD  (60*TICKINTERVAL)  // default cycles between MLFQ priority boosts
+#define FAIRLATENCY  (2*TICKINTERVAL)   // cycles in which every fair process should run
+#define FAIRMINSLICE (TICKINTERVAL/4)   // shortest fair class slice, in cycles
+#define NGROUP       16  // maximum number of CPU bandwidth groups
+#define NLOCKCLASS   64  // maximum number of lock names with statistics
+#define GANGSLICE    (2*TICKINTERVAL)   // cycles in each gang scheduling slot
@@ -0,0 +1,231 @@
+// Program page cache.
+//
+// Keeps whole pages of program files in memory, so that every
+// process running a program maps the same physical pages of its text
+// instead of reading them from the buffer cache into pages of its own.
+// exec() only notes where a program's segments are in the file;
+// execfault() maps their pages as they are first touched, from here.
+//
+// Interface:
+// * To get the page of a file starting at a byte offset, call pcget.
+//   It returns the page with a reference for the caller. exec() and
+//   mmap() map these pages directly.
+// * Before changing a file's contents, call pcinval, and then
+//   pcupdate with each piece written.
+//
+// Each cached page holds a reference of its own, so it outlives the
+// processes that map it. The least recently used page is dropped to
+// make room for a new one.
+//
+// MAP_SHARED mappings get pages of their own, apart from the
+// read-only ones that exec() and MAP_PRIVATE map, since they are
+// written in place. All of a file's sharers have to see the same
+// page, so a shared page that is mapped is never dropped: it is
+// skipped for eviction, kept by pcinval, and kept up to date with
+// write()s by pcupdate.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+
+#define NPCHASH 64
+
+struct cpage {
+  uint dev;
+  uint inum;
+  uint off;            // byte offset in the file of the page's first byte
+  int shared;          // for MAP_SHARED mappings?
+  char *page;          // 0 if this entry is free
+  uint64 used;         // pcache.clock when it was last looked up
+  struct cpage *next;  // next page of a file in the same hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct cpage pages[NPCACHE];
+  // the pages of each file are all on the chain of its inode.
+  struct cpage *hash[NPCHASH];
+  uint64 clock;
+} pcache;
+
+#define PCHASH(dev, inum) (&pcache.hash[((dev) * 31 + (inum)) % NPCHASH])
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+// Look for a cached page. Must hold pcache.lock.
+static struct cpage*
+pclookup(uint dev, uint inum, uint off, int shared)
+{
+  struct cpage *c;
+
+  for(c = *PCHASH(dev, inum); c; c = c->next)
+    if(c->dev == dev && c->inum == inum && c->off == off && c->shared == shared)
+      return c;
+  return 0;
+}
+
+// Is c a shared page that some process still maps?
+// Must hold pcache.lock.
+static int
+pcpinned(struct cpage *c)
+{
+  return c->shared && krefs(c->page) > 1;
+}
+
+// Unlink a page from its hash chain and drop the cache's
+// reference to it. Must hold pcache.lock.
+static void
+pcdrop(struct cpage *c)
+{
+  struct cpage **pp;
+
+  for(pp = PCHASH(c->dev, c->inum); *pp != c; pp = &(*pp)->next)
+    ;
+  *pp = c->next;
+  kfree(c->page);
+  c->page = 0;
+}
+
+// Return the PGSIZE bytes of ip starting at off, from the cache
+// or read in and cached, with a reference for the caller to kfree().
+// shared asks for the page MAP_SHARED mappings of the file use.
+// Any part of the page past the end of the file is zero.
+// Returns 0 if there is no memory, off is past the end of the file,
+// the file can't be read, or there is no room to cache a shared page.
+char*
+pcget(struct inode *ip, uint off, int shared)
+{
+  struct cpage *c, *victim;
+  char *mem;
+  uint gen;
+  int n, locked;
+
+ again:
+  acquire(&pcache.lock);
+  if((c = pclookup(ip->dev, ip->inum, off, shared)) != 0){
+    c->used = ++pcache.clock;
+    kref(c->page);
+    release(&pcache.lock);
+    return c->page;
+  }
+  release(&pcache.lock);
+
+  if((mem = kalloc()) == 0)
+    return 0;
+  memset(mem, 0, PGSIZE);
+  // the caller may be reading the program file itself,
+  // in which case it already holds the lock.
+  if((locked = holdingsleep(&ip->lock)) == 0)
+    ilock(ip);
+  acquire(&pcache.lock);
+  gen = ip->pcgen;
+  release(&pcache.lock);
+  n = readi(ip, 0, (uint64)mem, off, PGSIZE);
+  if(!locked)
+    iunlock(ip);
+  if(n <= 0){
+    kfree(mem);
+    return 0;
+  }
+
+  acquire(&pcache.lock);
+  if((c = pclookup(ip->dev, ip->inum, off, shared)) != 0){
+    // another process read it in meanwhile.
+    c->used = ++pcache.clock;
+    kref(c->page);
+    release(&pcache.lock);
+    kfree(mem);
+    return c->page;
+  }
+  // a file written since it was read isn't cached, but the
+  // caller still gets what it read, unless every sharer
+  // has to get the same page.
+  if(ip->pcgen != gen){
+    release(&pcache.lock);
+    if(shared){
+      kfree(mem);
+      goto again;
+    }
+    return mem;
+  }
+  victim = 0;
+  for(c = pcache.pages; c < &pcache.pages[NPCACHE]; c++){
+    if(c->page == 0){
+      victim = c;
+      break;
+    }
+    if(!pcpinned(c) && (victim == 0 || c->used < victim->used))
+      victim = c;
+  }
+  if(victim == 0){
+    release(&pcache.lock);
+    if(shared){
+      kfree(mem);
+      return 0;
+    }
+    return mem;
+  }
+  if(victim->page)
+    pcdrop(victim);
+  victim->dev = ip->dev;
+  victim->inum = ip->inum;
+  victim->off = off;
+  victim->shared = shared;
+  victim->page = mem;
+  victim->used = ++pcache.clock;
+  victim->next = *PCHASH(ip->dev, ip->inum);
+  *PCHASH(ip->dev, ip->inum) = victim;
+  kref(mem);
+  release(&pcache.lock);
+  return mem;
+}
+
+// Drop the cached pages of a file whose contents are about to
+// change. Processes already running it keep the pages they mapped.
+// Shared pages that are mapped stay, to be updated by pcupdate, or
+// zeroed if trunc is set because the file is being emptied.
+// Caller must hold ip->lock.
+void
+pcinval(struct inode *ip, int trunc)
+{
+  struct cpage *c, *next;
+
+  acquire(&pcache.lock);
+  ip->pcgen++;
+  for(c = *PCHASH(ip->dev, ip->inum); c; c = next){
+    next = c->next;
+    if(c->dev != ip->dev || c->inum != ip->inum)
+      continue;
+    if(!pcpinned(c))
+      pcdrop(c);
+    else if(trunc)
+      memset(c->page, 0, PGSIZE);
+  }
+  release(&pcache.lock);
+}
+
+// Copy n bytes just written to ip at off from src into the shared
+// page that holds them, if one is cached. The bytes must not
+// cross a page boundary. Caller must hold ip->lock.
+void
+pcupdate(struct inode *ip, uint off, char *src, uint n)
+{
+  struct cpage *c;
+  char *dst;
+
+  acquire(&pcache.lock);
+  c = pclookup(ip->dev, ip->inum, PGROUNDDOWN(off), 1);
+  // a MAP_SHARED page being written back is its own source.
+  if(c && (dst = c->page + off % PGSIZE) != src)
+    memmove(dst, src, n);
+  release(&pcache.lock);
+}
@@ -6,36 +6,126 @@
 #include "proc.h"
 #include "defs.h"
 #include "log.h"
-
-#define MAX_UINT64 (-1) 
-#define EMPTY MAX_UINT64 
-#define NUM_QUEUES 3 
+#include "sched.h"
+#include "rusage.h"
+
+// most MLFQ priority levels; nqueues of them are in use.
+// level 0 is the highest priority.
+// each cpu keeps a bitmap of its nonempty levels in a uint.
+#define NUM_QUEUES MAXQUEUES 
+#if NUM_QUEUES < 3 || NUM_QUEUES > 32
+#error "NUM_QUEUES must be between 3 and 32"
+#endif
+
+// index in qtable of the head of queue qid on the given cpu.
+// the tail is always the entry right after the head.
+#define QHEAD(cpu, qid) (NPROC + 2*((cpu)*NUM_QUEUES + (qid)))
+// cpu and level of the queue whose head is h.
+#define QCPU(h) (((h) - NPROC) / 2 / NUM_QUEUES)
+#define QLEVEL(h) (((h) - NPROC) / 2 % NUM_QUEUES)
  
 // a node of the linked list 
 struct qentry { 
-    uint64 queue; // used to store the queue level 
-    uint64 prev; // index of previous qentry in list 
-    uint64 next; // index of next qentry in list 
+    int queue; // level the entry was last dequeued from
+    int cpu; // cpu whose queues hold this entry, -1 if not queued
+    int prev; // index of previous qentry in list 
+    int next; // index of next qentry in list 
 }typedef qentry;
  
-// a fixed size table where the index of a process in proc[] is the same in qtable[] 
-struct qentry qtable[NPROC + 2*NUM_QUEUES]; 
+// a fixed size table where the slot of a process in proctab[] is its index in qtable[] 
+// followed by a head and tail entry for each queue of each cpu.
+// the queues of a cpu are protected by that cpu's qlock.
+struct qentry qtable[NPROC + 2*NUM_QUEUES*NCPU]; 
+
+// a scheduling policy. each cpu keeps a run queue for each class,
+// protected by its qlock, and tries the classes in order.
+struct sched_class {
+  int id;      // SCHED_ constant user space picks it by
+  char *name;
+  // queues p, which just became RUNNABLE, on cpu.
+  // caller holds p->lock and the cpu's qlock.
+  void (*enqueue)(int cpu, struct proc *p);
+  // dequeues the next process for cpu to run, or returns -1.
+  // caller holds the cpu's qlock.
+  int (*pick)(int cpu);
+  // dequeues a process on victim for the idle cpu thief,
+  // or returns -1. caller holds the victim's qlock.
+  int (*steal)(int victim, int thief);
+  // sets up p to run on c, and returns the cycles it may run
+  // before it is preempted. caller holds p->lock.
+  uint64 (*dispatch)(struct cpu *c, struct proc *p);
+  // charges the running p for its time since p->dispatched.
+  // caller holds p->lock.
+  void (*charge)(struct proc *p);
+  // optional: picks the cpu to queue p on; the default is the
+  // current cpu. caller holds p->lock.
+  int (*select_cpu)(struct proc *p);
+  // optional: does p preempt curr, which is running in the same
+  // class? curr is not locked, so this is only a hint.
+  int (*preempts)(struct proc *p, struct proc *curr);
+};
+extern struct sched_class *classes[];
+
+// index in oddtable of the head of a cpu's list of queued processes
+// whose base level is not the level a boost splices everything onto.
+// a boost only has to visit these one by one.
+#define ODDHEAD(cpu) (NPROC + 2*(cpu))
+
+// same layout as qtable, one head and tail per cpu;
+// also protected by the cpu's qlock.
+struct qentry oddtable[NPROC + 2*NCPU];
+
+// MLFQ tuning, set at run time by sched_setparam().
+// read without a lock; a process that lands on a level that was just
+// taken out of use still gets run, and the boost that sched_setparam()
+// forces moves it back.
+struct spinlock param_lock;  // serializes sched_setparam()
+int nqueues = 3;             // levels in use
+int quanta[NUM_QUEUES] = { 1, 10, 15 }; // quantum of each level, in ticks
+uint64 boostperiod = BOOSTPERIOD; // cycles between priority boosts
+uint64 nextboost;            // mtime when the next boost is due
+uint64 boostepoch;           // number of boosts so far
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// procs are carved out of kalloc()ed pages as they are first
+// needed and are never given back. proctab[slot] is the proc with
+// that slot, for every slot below nslots.
+struct proc *proctab[NPROC];
+int nslots;
+struct proc *freeprocs;      // UNUSED procs, linked through nextfree
+struct spinlock proc_lock;   // protects freeprocs and the growth of proctab
+uint64 kstackgen;            // bumped each time kernel stacks are mapped
 
 struct proc *initproc;
 
 int nextpid = 1;
 
-//Keeps track of the current tick
-int ticktimer = 0;
-
 struct spinlock pid_lock;
 
+// pid -> proc, chained through pidnext and protected by pid_lock.
+#define NPIDHASH 1024
+struct proc *pidhash[NPIDHASH];
+
+// sleepers, hashed by the channel they sleep on.
+// a waitq lock comes before the p->lock of its sleepers.
+#define NWAITQ 256
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+} waitq[NWAITQ];
+
+// the wait queue for chan. channels are addresses of kernel
+// objects, so multiply to spread them over the buckets.
+#define CHANQ(chan) (&waitq[((uint64)(chan) * 0x9E3779B97F4A7C15ULL) >> 56])
+
+extern pagetable_t kernel_pagetable;
+
 extern void forkret(void);
 static void freeproc(struct proc *p);
+void kick(int cpu, int id);
+void requeue(struct proc *p);
+int may_run(struct proc *p, int cpu);
 
 extern char trampoline[]; // trampoline.S
 
@@ -45,11 +135,51 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-struct logentry schedlog[LOG_SIZE]; 
+// a per-cpu ring of scheduling events. only its own cpu writes
+// to a ring, with interrupts off, so writers need no lock.
+// readers in sys_getlog() check head again after reading an
+// entry to find out whether it was overwritten meanwhile.
+struct logring {
+  struct logentry ent[LOG_SIZE];
+  uint64 head; // sequence number of the next entry to write
+} schedlog[NCPU];
 //boolean value. 1 if logging, 0 if not
 int is_logging = 0;
-//index of the next log struct to be placed in the array.
-int next_log_index = 0;
+
+// per-cpu, per-level log2 histograms of how long processes waited
+// between becoming RUNNABLE and being dispatched. each cpu only
+// updates its own histograms, from scheduler().
+uint64 lathist[NCPU][NUM_QUEUES][LAT_BUCKETS];
+
+/**
+ * @brief 
+ * records a scheduling event in this cpu's ring,
+ * overwriting the oldest entry once the ring is full
+ * @param p 
+ * process the event is about
+ * @param event 
+ * one of the LOG_ event types
+ */
+void log_event(struct proc *p, int event)
+{
+  struct logring *r;
+  struct logentry *e;
+
+  if(!is_logging)
+    return;
+  push_off();
+  r = &schedlog[cpuid()];
+  e = &r->ent[r->head & (LOG_SIZE - 1)];
+  e->time = mtime();
+  e->cpu = cpuid();
+  e->pid = p->pid;
+  e->queue = p->level;
+  e->event = event;
+  // publish the entry only once it is complete.
+  __sync_synchronize();
+  r->head++;
+  pop_off();
+}
 
 uint64 
 sys_startlog(void) 
@@ -61,234 +191,2325 @@ sys_startlog(void)
 
 /**
  * @brief 
- * 
- * @param h 
- * the index of the head of the queue
+ * 
+ * @param h 
+ * the index of the head of the queue
+ * @return int 
+ * return 0 if head.next is equal to the index of the queue's tail ie h+1
+ */
+int qnonempty(int h)
+{
+  return (h+1) != qtable[h].next;
+}
+
+int qisempty(int h)
+{
+  if(qnonempty(h))
+    return 0;
+  return 1;
+}
+
+/**
+ * @brief 
+ * finds the lowest set bit of a level bitmap in constant time
+ * using a de Bruijn sequence
+ * @param m 
+ * nonzero bitmap
+ * @return int 
+ * index of the lowest set bit
+ */
+int qffs(uint m)
+{
+  static const int debruijn[32] = {
+    0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+    31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9
+  };
+  return debruijn[((m & -m) * 0x077CB531U) >> 27];
+}
+
+/**
+ * @brief 
+ * finds the highest set bit of a level bitmap in constant time
+ * @param m 
+ * nonzero bitmap
+ * @return int 
+ * index of the highest set bit
+ */
+int qfls(uint m)
+{
+  m |= m >> 1;
+  m |= m >> 2;
+  m |= m >> 4;
+  m |= m >> 8;
+  m |= m >> 16;
+  return qffs(m - (m >> 1));
+}
+
+/**
+ * @brief 
+ * maps a nice value to an MLFQ level.
+ * nice <= -10 gets the top level, nice > 10 the bottom one,
+ * and the rest are spread over the levels in between
+ * @param nice 
+ * @return int 
+ */
+int nice_to_qid(int nice)
+{
+  int qid;
+  if (nice <= -10) qid = 0;
+  else if (nice <= 10) qid = 1 + (nice + 9) * (nqueues - 2) / 20;
+  else qid = nqueues - 1;
+  return qid;
+}
+
+/**
+ * @brief 
+ * calculates the qid that a process should be added to based on its nice value
+ * @param id 
+ * @return int 
+ */
+int calculate_qid(int id)
+{
+  return nice_to_qid(proctab[id]->nice);
+}
+
+/**
+ * @brief 
+ * the base level of a process with the default nice value of 0.
+ * a boost splices the lower levels onto this one wholesale.
+ * @return int 
+ */
+int boost_target(void)
+{
+  return nice_to_qid(0);
+}
+
+/**
+ * @brief 
+ * links id into the list of queued processes of a cpu that a boost
+ * has to move by hand, if its base level is not boost_target()
+ * caller must hold that cpu's qlock
+ * @param cpu 
+ * @param id 
+ */
+void odd_insert(int cpu, int id)
+{
+  int h = ODDHEAD(cpu);
+
+  if(calculate_qid(id) == boost_target())
+    return;
+  oddtable[id].next = oddtable[h].next;
+  oddtable[h].next = id;
+  oddtable[id].prev = h;
+  oddtable[oddtable[id].next].prev = id;
+  oddtable[id].cpu = cpu;
+}
+
+/**
+ * @brief 
+ * unlinks id from its cpu's odd list if it is on it
+ * caller must hold the qlock of that cpu
+ * @param id 
+ */
+void odd_remove(int id)
+{
+  qentry *e = &oddtable[id];
+
+  if(e->cpu < 0)
+    return;
+  oddtable[e->prev].next = e->next;
+  oddtable[e->next].prev = e->prev;
+  e->cpu = -1;
+}
+
+/**
+ * @brief 
+ * returns how long the quanta is for a process in a given queue
+ * @param qid 
+ * @return uint64 
+ * the quantum in cycles
+ */
+uint64 queue_quanta(int qid){
+  if (qid >= nqueues) qid = nqueues - 1;
+  return (uint64)quanta[qid] * TICKINTERVAL;
+}
+
+/**
+ * @brief 
+ * enqueues an item to the front of the queue with head h
+ * caller must hold the qlock of the cpu owning h
+ * @param h 
+ * id of the head of the queue
+ * @param id 
+ * index of the proc to insert
+ * @return int 
+ * 1 if inserted, 0 if id was already queued
+ */
+int enqueue(int h, int id)
+{
+  struct cpu *c = &cpus[QCPU(h)];
+
+  if(id < 0 || id >= NPROC || qtable[id].cpu >= 0)
+    return 0;
+  qtable[id].next = qtable[h].next;
+  qtable[h].next = id;
+  qtable[id].prev = h;
+  qtable[qtable[id].next].prev = id;
+  qtable[id].cpu = QCPU(h);
+  odd_insert(QCPU(h), id);
+  c->qmask |= 1U << QLEVEL(h);
+  c->qlen++;
+  return 1;
+}
+
+/**
+ * @brief 
+ * unlinks id from whatever queue holds it
+ * caller must hold the qlock of qtable[id].cpu
+ * @param id 
+ * index of the proc to remove
+ * @return int 
+ * id
+ */
+int qremove(int id)
+{
+  qentry *e = &qtable[id];
+  struct cpu *c = &cpus[e->cpu];
+
+  qtable[e->prev].next = e->next;
+  qtable[e->next].prev = e->prev;
+  // the queue is empty if id sat between its head and tail.
+  // a boost may have spliced id onto another level, so the
+  // level comes from the head rather than from id.
+  if(e->prev >= NPROC && e->next == e->prev + 1)
+    c->qmask &= ~(1U << QLEVEL(e->prev));
+  c->qlen--;
+  e->cpu = -1;
+  odd_remove(id);
+  return id;
+}
+
+/**
+ * @brief 
+ * removes the last element of the queue and records its level
+ * in qtable[id].queue for the scheduler
+ * caller must hold the qlock of the cpu owning h and the queue must be nonempty
+ * @param h 
+ * index of the head of the queue to dequeue
+ * @return int 
+ */
+int dequeue(int h)
+{
+  int id = qremove(qtable[h+1].prev);
+
+  qtable[id].queue = QLEVEL(h);
+  return id;
+}
+
+/**
+ * @brief 
+ * enqueues an item to the front of queue qid of a cpu
+ * acquires and releases that cpu's qlock
+ * @param cpu
+ * id of the cpu whose queues to use
+ * @param qid
+ * @param id 
+ * index of the proc to insert
+ * @return int 
+ */
+int enqueue_by_qid(int cpu, int qid, int id)
+{
+  struct cpu *c = &cpus[cpu];
+  int ret;
+
+  acquire(&c->qlock);
+  ret = enqueue(QHEAD(cpu, qid), id);
+  release(&c->qlock);
+  if(ret)
+    kick(cpu, id);
+  return ret;
+}
+
+/**
+ * @brief 
+ * dequeues an item from the back of queue qid of a cpu
+ * caller must hold that cpu's qlock and the queue must be nonempty
+ * @param cpu
+ * @param qid 
+ * @return int 
+ */
+int dequeue_by_qid(int cpu, int qid)
+{
+  return dequeue(QHEAD(cpu, qid));
+}
+
+/**
+ * @brief 
+ * dequeues from the highest priority nonempty queue of a cpu
+ * caller must hold that cpu's qlock
+ * @param cpu 
+ * @return int 
+ * index of the proc, or -1 if all of the cpu's queues are empty
+ */
+int dequeue_highest(int cpu)
+{
+  uint mask = cpus[cpu].qmask;
+
+  if(mask == 0)
+    return -1;
+  return dequeue_by_qid(cpu, qffs(mask));
+}
+
+/**
+ * @brief 
+ * sends an inter-processor interrupt to a hart through the CLINT.
+ * timervec in kernelvec.S turns it into a supervisor software interrupt.
+ * @param cpu 
+ */
+void ipi(int cpu)
+{
+  *(uint32*)CLINT_MSIP(cpu) = 1;
+}
+
+// bumped by kick() and gang_kick() whenever work is queued, so a
+// hart about to idle() can tell whether anything showed up since
+// it last looked.
+uint qgen;
+
+/**
+ * @brief 
+ * wakes a hart to run id, which was just queued on cpu.
+ * if cpu is idle it is woken; if it is busy running some other
+ * process, an idle peer is woken to steal the new work instead.
+ * @param cpu 
+ * @param id 
+ */
+void kick(int cpu, int id)
+{
+  struct proc *running = cpus[cpu].proc;
+
+  // pairs with the fence in idle(): either we see the idle flag
+  // or the idle hart sees qgen change.
+  __sync_fetch_and_add(&qgen, 1);
+  __sync_synchronize();
+  if(cpus[cpu].idle){
+    ipi(cpu);
+    return;
+  }
+  if(running == 0 || running == proctab[id])
+    return;
+  for(int i = 0; i < NCPU; i++){
+    if(cpus[i].idle && may_run(proctab[id], i)){
+      ipi(i);
+      return;
+    }
+  }
+}
+
+/**
+ * @brief 
+ * how many processes queued on a cpu another cpu could steal;
+ * deadline class processes never move.
+ * read without the qlock; it is only a hint.
+ * @param cpu 
+ * @return int 
+ */
+int stealable(int cpu)
+{
+  return cpus[cpu].qlen - cpus[cpu].dlqlen;
+}
+
+/**
+ * @brief 
+ * finds the other cpu with the most processes that could be stolen
+ * @param me 
+ * @return int 
+ * the busiest cpu, or -1 if no other cpu has any
+ */
+int busiest(int me)
+{
+  int i, victim = -1, max = 0;
+
+  for(i = 0; i < NCPU; i++){
+    if(i != me && stealable(i) > max){
+      max = stealable(i);
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+/**
+ * @brief 
+ * takes a process that may run on cpu me from a victim's queues,
+ * from the first class that has anything to give.
+ * @param victim 
+ * @param me 
+ * @return int 
+ * index of the stolen proc, or -1 if there was none
+ */
+int steal_from(int victim, int me)
+{
+  int id = -1;
+
+  acquire(&cpus[victim].qlock);
+  for(int i = 0; classes[i] && id < 0; i++)
+    id = classes[i]->steal(victim, me);
+  release(&cpus[victim].qlock);
+  return id;
+}
+
+/**
+ * @brief 
+ * takes a process for an idle cpu, from the busiest other cpu or,
+ * if none of its processes may run here, from any other cpu with
+ * one that might.
+ * @param me
+ * id of the idle cpu
+ * @return int 
+ * index of the stolen proc, or -1 if nothing queued anywhere
+ * may run on me
+ */
+int steal(int me)
+{
+  int victim = busiest(me), id;
+
+  if(victim < 0)
+    return -1;
+  if((id = steal_from(victim, me)) >= 0)
+    return id;
+  for(int i = 0; i < NCPU && id < 0; i++)
+    if(i != me && i != victim && stealable(i) > 0)
+      id = steal_from(i, me);
+  return id;
+}
+
+/**
+ * @brief 
+ * parks a hart that found nothing to run in wfi until an
+ * interrupt arrives, instead of spinning on the queues.
+ * kick() sends an IPI to harts parked here when work shows up.
+ * work this hart can't take, such as another cpu's deadline class
+ * processes or ones whose affinity keeps them off it, doesn't keep
+ * it awake; only work queued since it last looked does.
+ * @param c 
+ * the idle cpu
+ * @param gen 
+ * qgen from before the hart last looked for work
+ */
+void idle(struct cpu *c, uint gen)
+{
+  intr_off();
+  c->idle = 1;
+  // pairs with the fence in kick().
+  __sync_synchronize();
+  // wfi returns once an interrupt is pending, even with
+  // interrupts off, so an IPI sent after this check is not lost.
+  if(qgen == gen){
+    // nothing is running, so only hart 0 may still need ticks.
+    timerset();
+    wfi();
+  }
+  c->idle = 0;
+  intr_on();
+}
+
+/**
+ * @brief 
+ * checks whether the process running on this cpu has used up the
+ * quantum it was dispatched with, or was asked to give up the cpu
+ * by resched(). interrupts must be disabled.
+ * @return int 
+ * 1 if the quantum has ended, 0 otherwise
+ */
+int quantum_expired(void)
+{
+  struct cpu *c = mycpu();
+
+  return c->resched || (c->qend != 0 && mtime() >= c->qend);
+}
+
+/**
+ * @brief 
+ * tracepoint for a process moving between MLFQ levels
+ * @param p 
+ * @param from 
+ * old level
+ * @param to 
+ * new level
+ */
+void trace_level(struct proc *p, int from, int to)
+{
+  log_event(p, to > from ? LOG_DEMOTE : LOG_BOOST);
+}
+
+/**
+ * @brief 
+ * moves a process to a new MLFQ level with a fresh quantum
+ * @param p 
+ * @param level 
+ */
+void set_level(struct proc *p, int level)
+{
+  int old = p->level;
+
+  p->level = level;
+  p->runtime = 0;
+  if(old != level)
+    trace_level(p, old, level);
+}
+
+/**
+ * @brief 
+ * charges the running process for the cpu time since it was dispatched
+ * or last charged, and demotes it one level once it has used the whole
+ * quantum of its level. called on the way out of the cpu from yield(),
+ * sleep() and exit(), so time spent before blocking still counts.
+ * caller must hold p->lock.
+ * @param p 
+ */
+void mlfq_charge(struct proc *p)
+{
+  uint64 now = mtime();
+
+  p->runtime += now - p->dispatched;
+  p->dispatched = now;
+  if(p->runtime >= queue_quanta(p->level)){
+    if(p->level < nqueues - 1)
+      set_level(p, p->level + 1);
+    else
+      p->runtime = 0;
+  }
+}
+
+/**
+ * @brief 
+ * records how long a process about to be dispatched waited on a run queue
+ * in this cpu's histogram for its level. caller must hold p->lock.
+ * @param c 
+ * @param p 
+ */
+void record_latency(struct cpu *c, struct proc *p)
+{
+  uint64 wait = mtime() - p->enqueued;
+  int b;
+
+  if(wait >> 32)
+    b = LAT_BUCKETS - 1;
+  else if(wait == 0)
+    b = 0;
+  else
+    b = qfls((uint)wait);
+  lathist[c - cpus][p->level][b]++;
+}
+
+/**
+ * @brief 
+ * picks the MLFQ level a process that is being queued goes on:
+ * its current level, unless that predates the latest boost period or
+ * it was reniced below it, in which case it starts over at its base level.
+ * caller must hold p->lock.
+ * @param p 
+ * @return int 
+ * the level
+ */
+int mlfq_level(struct proc *p)
+{
+  int base = calculate_qid(p->slot);
+
+  if(p->boostepoch != boostepoch || p->level < base || p->level >= nqueues){
+    set_level(p, base);
+    p->boostepoch = boostepoch;
+  }
+  return p->level;
+}
+
+/**
+ * @brief 
+ * queues a process on a cpu's MLFQ at the level mlfq_level() picks.
+ * caller must hold p->lock and the cpu's qlock.
+ * @param cpu 
+ * @param p 
+ */
+void mlfq_enqueue(int cpu, struct proc *p)
+{
+  enqueue(QHEAD(cpu, mlfq_level(p)), p->slot);
+}
+
+/**
+ * @brief 
+ * checks a process's affinity mask. p->lock need not be held;
+ * a mask that is changing is only a hint until p is next queued.
+ * @param p 
+ * @param cpu 
+ * @return int 
+ * 1 if p may run on cpu
+ */
+int may_run(struct proc *p, int cpu)
+{
+  return (p->cpumask >> cpu) & 1;
+}
+
+/**
+ * @brief 
+ * takes a process that may run on the thief from the back of the
+ * victim's lowest priority MLFQ level that has one, which holds the
+ * work the victim would get to last.
+ * caller must hold the victim's qlock.
+ * @param victim 
+ * @param thief 
+ * @return int 
+ * index of the proc, or -1 if there is none
+ */
+int mlfq_steal(int victim, int thief)
+{
+  uint mask;
+  int qid, h, id;
+
+  for(mask = cpus[victim].qmask; mask; mask &= ~(1U << qid)){
+    qid = qfls(mask);
+    h = QHEAD(victim, qid);
+    for(id = qtable[h + 1].prev; id != h; id = qtable[id].prev){
+      if(may_run(proctab[id], thief)){
+        qremove(id);
+        qtable[id].queue = qid;
+        return id;
+      }
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief 
+ * gives a process about to run the level it was dequeued from.
+ * a boost since it was queued may have spliced it onto another level
+ * without touching it; it takes that level and a fresh quantum now.
+ * caller must hold p->lock.
+ * @param c 
+ * @param p 
+ * @return uint64 
+ * cycles left of the quantum at its level
+ */
+uint64 mlfq_dispatch(struct cpu *c, struct proc *p)
+{
+  int level = qtable[p->slot].queue;
+
+  if(p->level != level || p->boostepoch != boostepoch){
+    set_level(p, level);
+    p->boostepoch = boostepoch;
+  }
+  record_latency(c, p);
+  // a quantum shortened by sched_setparam() may already be used up.
+  if(p->runtime >= queue_quanta(p->level))
+    return 0;
+  return queue_quanta(p->level) - p->runtime;
+}
+
+// weight of each nice value from -20 to 19 in the fair class.
+// each step is about 1.25x, so a process gets about 10% more
+// cpu than one with a nice value one higher.
+static const int fairweight[40] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,
+   3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,
+    335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,
+     36,    29,    23,    18,    15,
+};
+#define NICE0WEIGHT 1024
+
+// a binary min-heap of proc slots, ordered by the before()
+// function its operations are given. protected by the lock
+// of the run queue it belongs to.
+struct procheap {
+  int n;            // number of slots in use
+  int slot[NPROC];
+};
+
+/**
+ * @brief 
+ * swaps two entries of a heap
+ * @param h 
+ * @param i 
+ * @param j 
+ */
+void heap_swap(struct procheap *h, int i, int j)
+{
+  int t = h->slot[i];
+
+  h->slot[i] = h->slot[j];
+  h->slot[j] = t;
+}
+
+/**
+ * @brief 
+ * adds a process to a heap in O(log n)
+ * @param h 
+ * @param id 
+ * @param before 
+ * returns 1 if its first slot should come out before its second
+ */
+void heap_push(struct procheap *h, int id, int (*before)(int, int))
+{
+  int i = h->n++;
+
+  h->slot[i] = id;
+  for(; i > 0 && before(h->slot[i], h->slot[(i - 1) / 2]); i = (i - 1) / 2)
+    heap_swap(h, i, (i - 1) / 2);
+}
+
+/**
+ * @brief 
+ * removes the first process of a heap in O(log n)
+ * @param h 
+ * @param before 
+ * @return int 
+ * index of the proc, or -1 if the heap is empty
+ */
+int heap_pop(struct procheap *h, int (*before)(int, int))
+{
+  int id, i, child;
+
+  if(h->n == 0)
+    return -1;
+  id = h->slot[0];
+  h->slot[0] = h->slot[--h->n];
+  for(i = 0; (child = 2*i + 1) < h->n; i = child){
+    if(child + 1 < h->n && before(h->slot[child + 1], h->slot[child]))
+      child++;
+    if(!before(h->slot[child], h->slot[i]))
+      break;
+    heap_swap(h, i, child);
+  }
+  return id;
+}
+
+/**
+ * @brief 
+ * removes the process at position i of a heap in O(log n)
+ * @param h 
+ * @param i 
+ * @param before 
+ * @return int 
+ * index of the proc
+ */
+int heap_remove(struct procheap *h, int i, int (*before)(int, int))
+{
+  int id = h->slot[i], child;
+
+  h->slot[i] = h->slot[--h->n];
+  if(i == h->n)
+    return id;
+  // the entry moved into the hole may belong above or below it.
+  for(; i > 0 && before(h->slot[i], h->slot[(i - 1) / 2]); i = (i - 1) / 2)
+    heap_swap(h, i, (i - 1) / 2);
+  for(; (child = 2*i + 1) < h->n; i = child){
+    if(child + 1 < h->n && before(h->slot[child + 1], h->slot[child]))
+      child++;
+    if(!before(h->slot[child], h->slot[i]))
+      break;
+    heap_swap(h, i, child);
+  }
+  return id;
+}
+
+// per-cpu heaps of the RUNNABLE fair class processes, by vruntime.
+// protected by the cpu's qlock.
+struct procheap fairq[NCPU];
+
+// per-cpu heaps of the RUNNABLE deadline class processes, by
+// absolute deadline. protected by the cpu's qlock.
+struct procheap dlq[NCPU];
+
+// the deadline class's admission control keeps each cpu's admitted
+// utilization, in parts per million, at or below DLMAXUTIL, which
+// leaves some of every cpu to the other classes.
+#define DLMAXUTIL 950000
+#define DLMAXPERIOD 10000000  // longest period, in microseconds
+struct spinlock dl_lock;      // protects every cpu's dlutil
+
+/**
+ * @brief 
+ * compares the vruntimes of the processes in two slots
+ * @param a 
+ * @param b 
+ * @return int 
+ * 1 if a should run before b
+ */
+int fair_before(int a, int b)
+{
+  return proctab[a]->vruntime < proctab[b]->vruntime;
+}
+
+/**
+ * @brief 
+ * queues a process on a cpu's fair heap. a process that slept is
+ * placed at most one latency period behind the cpu's least vruntime,
+ * so that it gets to run soon but can't bank sleep time to hog
+ * the cpu later. caller must hold p->lock and the cpu's qlock.
+ * @param cpu 
+ * @param p 
+ */
+void fair_enqueue(int cpu, struct proc *p)
+{
+  struct cpu *c = &cpus[cpu];
+
+  if(p->vruntime + FAIRLATENCY < c->minvruntime)
+    p->vruntime = c->minvruntime - FAIRLATENCY;
+  heap_push(&fairq[cpu], p->slot, fair_before);
+  c->qlen++;
+}
+
+/**
+ * @brief 
+ * picks the fair class process with the least vruntime, and moves
+ * the cpu's least vruntime forward to it.
+ * caller must hold the cpu's qlock.
+ * @param cpu 
+ * @return int 
+ * index of the proc, or -1 if the heap is empty
+ */
+int fair_pick(int cpu)
+{
+  struct cpu *c = &cpus[cpu];
+  int id = heap_pop(&fairq[cpu], fair_before);
+
+  if(id < 0)
+    return -1;
+  c->qlen--;
+  if(proctab[id]->vruntime > c->minvruntime)
+    c->minvruntime = proctab[id]->vruntime;
+  return id;
+}
+
+/**
+ * @brief 
+ * takes a process for another cpu from the leaves of a cpu's fair
+ * heap, starting with the last one, which is O(1) to remove and
+ * never the process that would run next. only processes that may
+ * run on the thief are taken. the vruntime of the one taken is
+ * moved from the victim's timeline to the thief's.
+ * caller must hold the victim's qlock.
+ * @param victim 
+ * @param thief 
+ * @return int 
+ * index of the proc, or -1 if there is none
+ */
+int fair_steal(int victim, int thief)
+{
+  struct cpu *c = &cpus[victim];
+  struct procheap *h = &fairq[victim];
+  struct proc *p;
+  int i;
+
+  for(i = h->n - 1; i >= 0 && !may_run(proctab[h->slot[i]], thief); i--)
+    ;
+  if(i < 0)
+    return -1;
+  p = proctab[heap_remove(h, i, fair_before)];
+  c->qlen--;
+  // the thief's minvruntime is read without its lock; it only
+  // ever grows, so at worst p starts a little early.
+  if(p->vruntime + cpus[thief].minvruntime < c->minvruntime)
+    p->vruntime = 0;
+  else
+    p->vruntime = p->vruntime + cpus[thief].minvruntime - c->minvruntime;
+  return p->slot;
+}
+
+/**
+ * @brief 
+ * gives a fair class process a slice of the latency period shared
+ * with the others queued on the cpu, and at least FAIRMINSLICE.
+ * caller must hold p->lock.
+ * @param c 
+ * @param p 
+ * @return uint64 
+ * cycles of the slice
+ */
+uint64 fair_dispatch(struct cpu *c, struct proc *p)
+{
+  uint64 slice = FAIRLATENCY / (fairq[c - cpus].n + 1);
+
+  return slice < FAIRMINSLICE ? FAIRMINSLICE : slice;
+}
+
+/**
+ * @brief 
+ * charges a fair class process for the cycles since it was dispatched
+ * or last charged, scaled by its weight: a heavier process's vruntime
+ * grows slower, so it is picked more often.
+ * caller must hold p->lock.
+ * @param p 
+ */
+void fair_charge(struct proc *p)
+{
+  uint64 now = mtime();
+
+  p->vruntime += (now - p->dispatched) * NICE0WEIGHT / fairweight[p->nice + 20];
+  p->dispatched = now;
+}
+
+/**
+ * @brief 
+ * compares the absolute deadlines of the processes in two slots
+ * @param a 
+ * @param b 
+ * @return int 
+ * 1 if a should run before b
+ */
+int dl_before(int a, int b)
+{
+  return proctab[a]->dlabs < proctab[b]->dlabs;
+}
+
+/**
+ * @brief 
+ * deadline class processes are partitioned: each only ever runs
+ * on the cpu it was admitted on.
+ * @param p 
+ * @return int 
+ */
+int dl_select(struct proc *p)
+{
+  return p->dlcpu;
+}
+
+/**
+ * @brief 
+ * queues a deadline class process by its absolute deadline.
+ * one whose deadline has passed, such as a periodic task waking up
+ * for its next period, starts a new job with a full budget.
+ * caller must hold p->lock and the cpu's qlock.
+ * @param cpu 
+ * @param p 
+ */
+void dl_enqueue(int cpu, struct proc *p)
+{
+  uint64 now = mtime();
+
+  if(now >= p->dlabs){
+    p->dlabs = now + p->dldeadline;
+    p->dlbudget = p->dlruntime;
+  }
+  heap_push(&dlq[cpu], p->slot, dl_before);
+  cpus[cpu].qlen++;
+  cpus[cpu].dlqlen++;
+}
+
+/**
+ * @brief 
+ * picks the deadline class process with the earliest deadline
+ * caller must hold the cpu's qlock.
+ * @param cpu 
+ * @return int 
+ * index of the proc, or -1 if none is queued
+ */
+int dl_pick(int cpu)
+{
+  int id = heap_pop(&dlq[cpu], dl_before);
+
+  if(id >= 0){
+    cpus[cpu].qlen--;
+    cpus[cpu].dlqlen--;
+  }
+  return id;
+}
+
+/**
+ * @brief 
+ * deadline class processes are never stolen; admission control
+ * only guarantees their deadlines on their own cpu.
+ * @param victim 
+ * @param thief 
+ * @return int 
+ * -1
+ */
+int dl_steal(int victim, int thief)
+{
+  return -1;
+}
+
+/**
+ * @brief 
+ * lets a deadline class process run for what is left of its budget
+ * caller must hold p->lock.
+ * @param c 
+ * @param p 
+ * @return uint64 
+ */
+uint64 dl_dispatch(struct cpu *c, struct proc *p)
+{
+  return p->dlbudget ? p->dlbudget : 1;
+}
+
+/**
+ * @brief 
+ * charges a deadline class process's budget. one that has used up
+ * its budget is throttled until its next period starts, when
+ * dl_replenish() gives it a new one, so it can't take more than its
+ * reserved bandwidth from the others. a job still running past its
+ * deadline is logged as a LOG_DLMISS and carries on with what is
+ * left of its budget under a new deadline.
+ * caller must hold p->lock.
+ * @param p 
+ */
+void dl_charge(struct proc *p)
+{
+  uint64 now = mtime(), used = now - p->dispatched;
+
+  p->dispatched = now;
+  if(now > p->dlabs)
+    log_event(p, LOG_DLMISS);
+  if(used < p->dlbudget){
+    p->dlbudget -= used;
+    if(now > p->dlabs)
+      p->dlabs = now + p->dldeadline;
+    return;
+  }
+  p->dlbudget = 0;
+  p->dlreplenish = p->dlabs - p->dldeadline + p->dlperiod;
+  if(p->dlreplenish <= now){
+    // its next period has already begun.
+    p->dlreplenish = 0;
+    p->dlabs = now + p->dldeadline;
+    p->dlbudget = p->dlruntime;
+  }
+}
+
+/**
+ * @brief 
+ * parks a deadline class process that ran out of budget on its
+ * cpu until its next period, instead of letting it be queued.
+ * caller must hold p->lock.
+ * @param p 
+ * @return int 
+ * 1 if p was parked
+ */
+int dl_park(struct proc *p)
+{
+  struct cpu *c = &cpus[p->dlcpu];
+
+  if(p->dlreplenish == 0)
+    return 0;
+  acquire(&c->qlock);
+  if(c->dlparked == 0 || p->dlreplenish < c->dlnext)
+    c->dlnext = p->dlreplenish;
+  p->parknext = c->dlparked;
+  c->dlparked = p;
+  release(&c->qlock);
+  // pairs with the fence in idle(): an idle cpu has to set its
+  // timer for the replenishment.
+  __sync_synchronize();
+  if(c->idle)
+    ipi(p->dlcpu);
+  return 1;
+}
+
+/**
+ * @brief 
+ * gives the parked deadline class processes of this cpu whose next
+ * period has begun a full budget, and queues them again. called from
+ * the timer interrupt, with no locks held.
+ */
+void dl_replenish(void)
+{
+  struct cpu *c = mycpu();
+  uint64 now = mtime();
+  struct proc *p, *next, *ready = 0, **pp;
+
+  if(c->dlparked == 0 || now < c->dlnext)
+    return;
+  acquire(&c->qlock);
+  c->dlnext = -1;
+  for(pp = &c->dlparked; (p = *pp) != 0; ){
+    if(p->dlreplenish <= now){
+      *pp = p->parknext;
+      p->parknext = ready;
+      ready = p;
+    } else {
+      if(p->dlreplenish < c->dlnext)
+        c->dlnext = p->dlreplenish;
+      pp = &p->parknext;
+    }
+  }
+  release(&c->qlock);
+
+  // parked processes stay RUNNABLE, so nothing else touches them.
+  for(p = ready; p; p = next){
+    next = p->parknext;
+    acquire(&p->lock);
+    p->dlabs = p->dlreplenish + p->dldeadline;
+    p->dlbudget = p->dlruntime;
+    p->dlreplenish = 0;
+    requeue(p);
+    release(&p->lock);
+  }
+}
+
+/**
+ * @brief 
+ * when this cpu next has a parked deadline class process to
+ * replenish, for timerset()
+ * @return uint64 
+ * an mtime, or -1 if none is parked
+ */
+uint64 dl_next(void)
+{
+  struct cpu *c = mycpu();
+
+  return c->dlparked ? c->dlnext : -1;
+}
+
+/**
+ * @brief 
+ * earliest deadline first: p preempts another deadline class
+ * process whose deadline is later.
+ * @param p 
+ * @param curr 
+ * @return int 
+ */
+int dl_preempts(struct proc *p, struct proc *curr)
+{
+  return p->dlabs < curr->dlabs;
+}
+
+/**
+ * @brief 
+ * gives up the utilization reserved for a deadline class process
+ * @param p 
+ */
+void dl_release(struct proc *p)
+{
+  acquire(&dl_lock);
+  cpus[p->dlcpu].dlutil -= p->dlutil;
+  p->dlutil = 0;
+  release(&dl_lock);
+}
+
+struct sched_class dl_class = {
+  .id = SCHED_DEADLINE,
+  .name = "deadline",
+  .enqueue = dl_enqueue,
+  .pick = dl_pick,
+  .steal = dl_steal,
+  .dispatch = dl_dispatch,
+  .charge = dl_charge,
+  .select_cpu = dl_select,
+  .preempts = dl_preempts,
+};
+
+struct sched_class mlfq_class = {
+  .id = SCHED_MLFQ,
+  .name = "mlfq",
+  .enqueue = mlfq_enqueue,
+  .pick = dequeue_highest,
+  .steal = mlfq_steal,
+  .dispatch = mlfq_dispatch,
+  .charge = mlfq_charge,
+};
+
+struct sched_class fair_class = {
+  .id = SCHED_FAIR,
+  .name = "fair",
+  .enqueue = fair_enqueue,
+  .pick = fair_pick,
+  .steal = fair_steal,
+  .dispatch = fair_dispatch,
+  .charge = fair_charge,
+};
+
+// every scheduling class, highest priority first, and then a null.
+// a cpu only runs a process of a class when every class before it
+// has nothing queued on that cpu.
+struct sched_class *classes[] = { &dl_class, &mlfq_class, &fair_class, 0 };
+
+// class of processes that are in SCHED_DEFAULT; set by setclass().
+int defaultclass = SCHED_MLFQ;
+
+/**
+ * @brief 
+ * finds the class a process should be queued in
+ * @param p 
+ * @return struct sched_class* 
+ */
+struct sched_class *class_of(struct proc *p)
+{
+  int id = p->policy == SCHED_DEFAULT ? defaultclass : p->policy;
+
+  for(int i = 0; classes[i]; i++)
+    if(classes[i]->id == id)
+      return classes[i];
+  return &mlfq_class;
+}
+
+/**
+ * @brief 
+ * finds the position of a class in classes[]
+ * @param cls 
+ * @return int 
+ * lower for classes that run first
+ */
+int class_rank(struct sched_class *cls)
+{
+  int i;
+
+  for(i = 0; classes[i] && classes[i] != cls; i++)
+    ;
+  return i;
+}
+
+/**
+ * @brief 
+ * decides whether p, just queued, should take the cpu from curr
+ * right away: it is in a higher priority class, or its class
+ * says so. curr is read without its lock, so this is only a hint.
+ * @param p 
+ * @param curr 
+ * the process running on p's cpu, or 0
+ * @return int 
+ */
+int preempts(struct proc *p, struct proc *curr)
+{
+  struct sched_class *cls;
+
+  if(curr == 0 || curr == p || (cls = curr->sclass) == 0)
+    return 0;
+  if(class_rank(p->sclass) != class_rank(cls))
+    return class_rank(p->sclass) < class_rank(cls);
+  return cls->preempts && cls->preempts(p, curr);
+}
+
+/**
+ * @brief 
+ * makes the process running on a cpu give it up at its next
+ * interrupt. the IPI brings on that interrupt, even when it is
+ * this cpu.
+ * @param cpu 
+ */
+void resched(int cpu)
+{
+  cpus[cpu].resched = 1;
+  ipi(cpu);
+}
+
+/**
+ * @brief 
+ * dequeues the next process for a cpu to run from the highest
+ * priority class with anything queued there.
+ * caller must hold the cpu's qlock.
+ * @param cpu 
+ * @return int 
+ * index of the proc, or -1 if nothing is queued on the cpu
+ */
+int pick_next(int cpu)
+{
+  int id = -1;
+
+  for(int i = 0; classes[i] && id < 0; i++)
+    id = classes[i]->pick(cpu);
+  return id;
+}
+
+// CPU bandwidth groups. every process is in one, inherited across
+// fork(). a group with a quota may use at most quota cycles of cpu,
+// summed over its members, in each period; once it has, its members
+// are parked on the group instead of being queued until the period
+// ends. group 0 holds everyone else and has no quota.
+struct group {
+  struct spinlock lock;
+  int inuse;
+  int nprocs;           // members
+  uint64 quota;         // cycles per period, or 0 for no limit
+  uint64 period;        // cycles
+  uint64 start;         // mtime the current period began
+  uint64 spent;         // cycles used in the current period
+  uint64 total;         // cycles used since the group was made
+  uint64 nthrottled;    // periods in which the quota ran out
+  int throttled;        // out of quota until the period ends?
+  struct proc *parked;  // members waiting for the next period
+  int gang;             // are its members gang scheduled?
+  int nready;           // members on ready
+  struct proc *ready;   // RUNNABLE members of a gang, oldest first
+  struct proc *readytail;
+} groups[NGROUP];
+
+// gang scheduling. hart 0 hands out time slots of GANGSLICE cycles
+// in turn to each gang with members, and then one to everyone else.
+// in a gang's slot every hart runs one of its members if one is
+// ready, so members that hand work to each other through pipes are
+// running at the same time. a hart with none of its members to run
+// runs other work, and in the open slot gang members only fill in
+// on harts that have nothing else to do.
+int gangcur;          // gang whose slot it is, or 0 in the open slot
+uint64 gangend;       // mtime the current slot ends
+int ngangs;           // groups with gang set
+
+/**
+ * @brief 
+ * charges a process's group for cpu time, and throttles the group
+ * if that uses up its quota. members running on other harts are
+ * told to give up their cpu, so they are parked too.
+ * caller must hold p->lock.
+ * @param p 
+ * @param used 
+ * cycles to charge
+ */
+void group_charge(struct proc *p, uint64 used)
+{
+  struct group *g = &groups[p->group];
+  uint64 now = mtime();
+  int throttle = 0;
+
+  if(g->quota == 0){
+    __sync_fetch_and_add(&g->total, used);
+    return;
+  }
+  acquire(&g->lock);
+  // a throttled group's period is only rolled over by group_refill(),
+  // which also unparks its members.
+  if(!g->throttled && now >= g->start + g->period){
+    g->start = now - (now - g->start) % g->period;
+    g->spent = 0;
+  }
+  g->spent += used;
+  g->total += used;
+  if(!g->throttled && g->spent >= g->quota){
+    g->throttled = 1;
+    g->nthrottled++;
+    throttle = 1;
+  }
+  release(&g->lock);
+
+  if(throttle){
+    for(int i = 0; i < NCPU; i++){
+      struct proc *curr = cpus[i].proc;
+      if(curr && curr != p && curr->group == p->group)
+        resched(i);
+    }
+  }
+}
+
+/**
+ * @brief 
+ * charges the process leaving the cpu for its time since it was
+ * dispatched or last charged, to its group and in its class.
+ * caller must hold p->lock.
+ * @param p 
+ */
+void charge(struct proc *p)
+{
+  group_charge(p, mtime() - p->dispatched);
+  p->sclass->charge(p);
+}
+
+/**
+ * @brief 
+ * parks a RUNNABLE process on its group if the group is throttled,
+ * instead of letting it be queued or run.
+ * caller must hold p->lock.
+ * @param p 
+ * @return int 
+ * 1 if p was parked
+ */
+int group_park(struct proc *p)
+{
+  struct group *g = &groups[p->group];
+
+  if(!g->throttled)
+    return 0;
+  acquire(&g->lock);
+  if(!g->throttled){
+    release(&g->lock);
+    return 0;
+  }
+  p->parknext = g->parked;
+  g->parked = p;
+  release(&g->lock);
+  return 1;
+}
+
+/**
+ * @brief 
+ * how much longer a process's group lets it run this period
+ * @param p 
+ * @return uint64 
+ * cycles, or -1 if there is no quota
+ */
+uint64 group_left(struct proc *p)
+{
+  struct group *g = &groups[p->group];
+
+  if(g->quota == 0)
+    return -1;
+  return g->spent < g->quota ? g->quota - g->spent : 0;
+}
+
+/**
+ * @brief 
+ * starts a new period for every throttled group whose period has
+ * ended, and queues its parked members again. called from the timer
+ * interrupt on hart 0, with no locks held.
+ */
+void group_refill(void)
+{
+  uint64 now = mtime();
+  struct group *g;
+  struct proc *p, *next;
+
+  for(g = &groups[1]; g < &groups[NGROUP]; g++){
+    if(!g->throttled || now < g->start + g->period)
+      continue;
+    acquire(&g->lock);
+    if(!g->throttled || now < g->start + g->period){
+      release(&g->lock);
+      continue;
+    }
+    g->start = now - (now - g->start) % g->period;
+    g->spent = 0;
+    g->throttled = 0;
+    p = g->parked;
+    g->parked = 0;
+    release(&g->lock);
+
+    // parked processes stay RUNNABLE, so nothing else touches them.
+    for(; p; p = next){
+      next = p->parknext;
+      acquire(&p->lock);
+      requeue(p);
+      release(&p->lock);
+    }
+  }
+}
+
+/**
+ * @brief 
+ * when the next throttled group's period ends, for timerset()
+ * @return uint64 
+ * an mtime, or -1 if no group is throttled
+ */
+uint64 group_next(void)
+{
+  uint64 next = -1;
+
+  for(struct group *g = &groups[1]; g < &groups[NGROUP]; g++)
+    if(g->throttled && g->start + g->period < next)
+      next = g->start + g->period;
+  return next;
+}
+
+/**
+ * @brief 
+ * unlinks a member from whichever of its group's lists it is on.
+ * caller must hold p->lock and g->lock.
+ * @param g 
+ * @param p 
+ * @return int 
+ * 1 if p was parked or ready on g
+ */
+int group_unlink(struct group *g, struct proc *p)
+{
+  struct proc **pp, *prev = 0;
+
+  for(pp = &g->parked; *pp; pp = &(*pp)->parknext){
+    if(*pp == p){
+      *pp = p->parknext;
+      return 1;
+    }
+  }
+  for(pp = &g->ready; *pp; prev = *pp, pp = &(*pp)->parknext){
+    if(*pp == p){
+      *pp = p->parknext;
+      if(g->readytail == p)
+        g->readytail = prev;
+      g->nready--;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief 
+ * finds a hart to run a gang member that just became ready:
+ * an idle one, or in its gang's slot one running a process from
+ * outside the gang, which is told to give up its cpu.
+ * @param p 
+ */
+void gang_kick(struct proc *p)
+{
+  int i;
+
+  // pairs with the fence in idle().
+  __sync_fetch_and_add(&qgen, 1);
+  __sync_synchronize();
+  for(i = 0; i < NCPU; i++){
+    if(cpus[i].idle && may_run(p, i)){
+      ipi(i);
+      return;
+    }
+  }
+  if(gangcur != p->group)
+    return;
+  for(i = 0; i < NCPU; i++){
+    struct proc *curr = cpus[i].proc;
+    if(cpus[i].online && may_run(p, i) && curr && curr->group != p->group){
+      resched(i);
+      return;
+    }
+  }
+}
+
+/**
+ * @brief 
+ * puts a RUNNABLE member of a gang on its gang's ready list, where
+ * every hart looks for it, instead of on one cpu's run queue.
+ * deadline class members keep to their own class, whose admission
+ * control has reserved a cpu for them.
+ * caller must hold p->lock, and p->sclass must be set.
+ * @param p 
+ * @return int 
+ * 1 if p was put on the list, 0 if p is not in a gang
+ */
+int gang_queue(struct proc *p)
+{
+  struct group *g = &groups[p->group];
+
+  if(!g->gang || p->sclass == &dl_class)
+    return 0;
+  // mlfq_dispatch() takes the level from where p was dequeued.
+  if(p->sclass == &mlfq_class)
+    qtable[p->slot].queue = mlfq_level(p);
+  p->enqueued = mtime();
+  acquire(&g->lock);
+  if(!g->gang){
+    release(&g->lock);
+    return 0;
+  }
+  p->parknext = 0;
+  if(g->readytail)
+    g->readytail->parknext = p;
+  else
+    g->ready = p;
+  g->readytail = p;
+  g->nready++;
+  release(&g->lock);
+  gang_kick(p);
+  return 1;
+}
+
+/**
+ * @brief 
+ * takes the oldest ready member of a gang that may run on a cpu
+ * @param gid 
+ * @param cpu 
+ * @return int 
+ * index of the proc, or -1 if there is none
+ */
+int gang_pick(int gid, int cpu)
+{
+  struct group *g = &groups[gid];
+  struct proc *p;
+  int id = -1;
+
+  if(g->nready == 0)
+    return -1;
+  acquire(&g->lock);
+  for(p = g->ready; p; p = p->parknext){
+    if(may_run(p, cpu)){
+      id = p->slot;
+      group_unlink(g, p);
+      break;
+    }
+  }
+  release(&g->lock);
+  return id;
+}
+
+/**
+ * @brief 
+ * takes a ready member of any gang for a cpu that has nothing else
+ * to run, starting with the gang whose slot it is
+ * @param cpu 
+ * @return int 
+ * index of the proc, or -1 if there is none
+ */
+int gang_fill(int cpu)
+{
+  int id = -1;
+  // groups 1 to NGROUP-1, from gangcur, or from 1 in the open slot.
+  int first = gangcur ? gangcur - 1 : 0;
+
+  if(ngangs == 0)
+    return -1;
+  for(int i = 0; i < NGROUP - 1 && id < 0; i++)
+    id = gang_pick((first + i) % (NGROUP - 1) + 1, cpu);
+  return id;
+}
+
+/**
+ * @brief 
+ * hands the next slot to the next gang with members, or to
+ * everyone else after the last one, once the current slot ends.
+ * harts running something outside the new slot's gang are told
+ * to give up their cpu. called from the timer interrupt on hart 0.
+ */
+void gang_rotate(void)
+{
+  uint64 now = mtime();
+  int next = 0;
+
+  if(ngangs == 0 || now < gangend)
+    return;
+  for(int i = gangcur + 1; i < NGROUP; i++){
+    if(groups[i].gang && groups[i].nprocs > 0){
+      next = i;
+      break;
+    }
+  }
+  gangcur = next;
+  gangend = now + GANGSLICE;
+  if(next == 0)
+    return;
+  for(int i = 0; i < NCPU; i++){
+    struct proc *curr = cpus[i].proc;
+    if(cpus[i].online && (curr ? curr->group != next : groups[next].nready > 0))
+      resched(i);
+  }
+}
+
+/**
+ * @brief 
+ * when the current gang slot ends, for timerset()
+ * @return uint64 
+ * an mtime, or -1 if there are no gangs
+ */
+uint64 gang_next(void)
+{
+  return ngangs ? gangend : -1;
+}
+
+/**
+ * @brief 
+ * finds the least loaded online cpu in a mask
+ * @param mask 
+ * @return int 
+ * the cpu, or -1 if no cpu in mask is online
+ */
+int least_loaded(uint64 mask)
+{
+  int best = -1;
+
+  for(int i = 0; i < NCPU; i++){
+    if(((mask >> i) & 1) && cpus[i].online &&
+       (best < 0 || cpus[i].qlen < cpus[best].qlen))
+      best = i;
+  }
+  return best;
+}
+
+/**
+ * @brief 
+ * picks the cpu to queue a process on when its class doesn't care:
+ * the hart it last ran on, whose caches may still hold its working
+ * set, unless that hart has other work and there is an idle hart
+ * the process may run on. a process that never ran goes on this cpu.
+ * caller must hold p->lock.
+ * @param p 
+ * @return int 
+ */
+int wake_cpu(struct proc *p)
+{
+  int last = p->lastcpu;
+  struct cpu *c;
+
+  if(last < 0)
+    return cpuid();
+  c = &cpus[last];
+  // qlen and proc of another cpu are only hints.
+  if(c->qlen == 0 && (c->proc == 0 || c->proc == p))
+    return last;
+  for(int i = 0; i < NCPU; i++)
+    if(cpus[i].idle && may_run(p, i))
+      return i;
+  return last;
+}
+
+/**
+ * @brief 
+ * picks the cpu to queue a process on: the one its class picks,
+ * or else wake_cpu(), unless the process may not run there, in which
+ * case the least loaded cpu it may run on.
+ * caller must hold p->lock.
+ * @param p 
+ * @return int 
+ */
+int select_cpu(struct proc *p)
+{
+  int cpu = p->sclass->select_cpu ? p->sclass->select_cpu(p) : wake_cpu(p);
+  int other;
+
+  if(!may_run(p, cpu) && (other = least_loaded(p->cpumask)) >= 0)
+    cpu = other;
+  return cpu;
+}
+
+/**
+ * @brief 
+ * queues a process that just became RUNNABLE in the class it
+ * currently belongs to, on the cpu select_cpu() picks,
+ * and preempts whatever runs there if it should. a process whose
+ * group is throttled is parked on the group instead, a deadline
+ * class process out of budget is parked on its cpu, and a gang
+ * member goes on its gang's ready list.
+ * this is the way back in for yielding and woken processes alike.
+ * caller must hold p->lock.
+ * @param p 
+ */
+void requeue(struct proc *p)
+{
+  int cpu;
+  struct cpu *c;
+
+  // a process that slept through the boost catches up here.
+  boost_if_due();
+  if(group_park(p))
+    return;
+  p->sclass = class_of(p);
+  if(p->sclass == &dl_class && dl_park(p))
+    return;
+  if(gang_queue(p))
+    return;
+  cpu = select_cpu(p);
+  c = &cpus[cpu];
+  p->enqueued = mtime();
+  acquire(&c->qlock);
+  p->sclass->enqueue(cpu, p);
+  release(&c->qlock);
+  if(preempts(p, c->proc))
+    resched(cpu);
+  else
+    kick(cpu, p->slot);
+}
+
+/**
+ * @brief 
+ * sets the scheduling class of a process, or the class of every
+ * process left in SCHED_DEFAULT if pid is 0. a process moves to its
+ * new class the next time it is queued. a negative class only
+ * reports the current one. processes only enter and leave
+ * SCHED_DEADLINE through setdeadline().
+ * setclass(int pid, int class)
+ * @return uint64 
+ * the previous class, or -1 on error
+ */
+uint64
+sys_setclass(void)
+{
+  int pid, class, old;
+  struct proc *p;
+
+  if(argint(0, &pid) < 0 || argint(1, &class) < 0)
+    return -1;
+  if(class >= NSCHED || class == SCHED_DEADLINE ||
+     (pid == 0 && class == SCHED_DEFAULT))
+    return -1;
+  if(pid == 0){
+    acquire(&param_lock);
+    old = defaultclass;
+    if(class >= 0)
+      defaultclass = class;
+    release(&param_lock);
+    return old;
+  }
+  if((p = findproc(pid)) == 0)
+    return -1;
+  old = p->policy;
+  if(class >= 0 && old == SCHED_DEADLINE){
+    release(&p->lock);
+    return -1;
+  }
+  if(class >= 0)
+    p->policy = class;
+  release(&p->lock);
+  return old;
+}
+
+/**
+ * @brief 
+ * puts the calling process in the deadline class, to run for runtime
+ * microseconds by a deadline after the start of each period.
+ * it is admitted on the cpu in its affinity mask with the least
+ * deadline class utilization that can take it, or rejected if none can. a runtime of 0 takes it
+ * back out to SCHED_DEFAULT.
+ * setdeadline(int runtime, int deadline, int period)
+ * @return uint64 
+ * 0 on success, -1 if the parameters are invalid or not admitted
+ */
+uint64
+sys_setdeadline(void)
+{
+  int runtime, deadline, period, best = -1;
+  uint util;
+  struct proc *p = myproc();
+
+  if(argint(0, &runtime) < 0 || argint(1, &deadline) < 0 ||
+     argint(2, &period) < 0)
+    return -1;
+  if(runtime == 0){
+    acquire(&p->lock);
+    if(p->policy == SCHED_DEADLINE){
+      dl_release(p);
+      p->policy = SCHED_DEFAULT;
+    }
+    release(&p->lock);
+    return 0;
+  }
+  if(runtime < 0 || runtime > deadline || deadline > period ||
+     period > DLMAXPERIOD)
+    return -1;
+  util = (uint64)runtime * 1000000 / deadline;
+
+  // p->policy only changes to or from SCHED_DEADLINE here and
+  // in freeproc(), so it can be read without p->lock.
+  acquire(&dl_lock);
+  if(p->policy == SCHED_DEADLINE)
+    cpus[p->dlcpu].dlutil -= p->dlutil;
+  for(int i = 0; i < NCPU; i++){
+    if(cpus[i].online && may_run(p, i) && cpus[i].dlutil + util <= DLMAXUTIL &&
+       (best < 0 || cpus[i].dlutil < cpus[best].dlutil))
+      best = i;
+  }
+  if(best < 0){
+    if(p->policy == SCHED_DEADLINE)
+      cpus[p->dlcpu].dlutil += p->dlutil;
+    release(&dl_lock);
+    return -1;
+  }
+  cpus[best].dlutil += util;
+  release(&dl_lock);
+
+  acquire(&p->lock);
+  p->dlcpu = best;
+  p->dlutil = util;
+  p->dlruntime = (uint64)runtime * (MTIMEHZ / 1000000);
+  p->dldeadline = (uint64)deadline * (MTIMEHZ / 1000000);
+  p->dlperiod = (uint64)period * (MTIMEHZ / 1000000);
+  p->dlabs = 0;
+  p->dlreplenish = 0;
+  p->policy = SCHED_DEADLINE;
+  release(&p->lock);
+
+  // move to the deadline queue of its cpu right away.
+  yield();
+  return 0;
+}
+
+/**
+ * @brief 
+ * copies one cpu's scheduling latency histograms to user space
+ * as LAT_LEVELS rows of LAT_BUCKETS counts, one row per MLFQ level.
+ * getlat(int cpu, uint64 *hist)
+ * @return uint64 
+ * the number of MLFQ levels, or -1 on error
+ */
+uint64
+sys_getlat(void)
+{
+  int cpu, qid;
+  uint64 uhist;
+  struct proc *p = myproc();
+
+  if(argint(0, &cpu) < 0 || argaddr(1, &uhist) < 0)
+    return -1;
+  if(cpu < 0 || cpu >= NCPU)
+    return -1;
+  for(qid = 0; qid < nqueues && qid < LAT_LEVELS; qid++){
+    if(copyout(p->pagetable, uhist + qid * sizeof(lathist[cpu][qid]),
+               (char *)lathist[cpu][qid], sizeof(lathist[cpu][qid])) < 0)
+      return -1;
+  }
+  return qid;
+}
+
+/**
+ * @brief 
+ * moves the whole of one nonempty queue of a cpu to the front of
+ * another in constant time. the moved entries keep their stale level
+ * until they are dispatched. caller must hold the cpu's qlock.
+ * @param cpu 
+ * @param from 
+ * level to empty
+ * @param to 
+ * level to add the entries to
+ */
+void splice(int cpu, int from, int to)
+{
+  struct cpu *c = &cpus[cpu];
+  int hf = QHEAD(cpu, from), ht = QHEAD(cpu, to);
+  int first = qtable[hf].next, last = qtable[hf + 1].prev;
+
+  qtable[last].next = qtable[ht].next;
+  qtable[qtable[ht].next].prev = last;
+  qtable[ht].next = first;
+  qtable[first].prev = ht;
+  qtable[hf].next = hf + 1;
+  qtable[hf + 1].prev = hf;
+  c->qmask = (c->qmask & ~(1U << from)) | (1U << to);
+}
+
+/**
+ * @brief 
+ * boosts every queued process of a cpu back to its base level.
+ * the levels below boost_target() are spliced onto it whole, then only
+ * the processes on the odd list, whose base level differs, are moved
+ * one at a time. the cost is O(levels) plus the reniced processes,
+ * however many are queued. levels and fresh quanta are handed out
+ * when the processes are dispatched.
+ * @param cpu
+ * id of the cpu whose queues to boost
  * @return int 
- * return 0 if head.next is equal to the index of the queue's tail ie h+1
+ * returns 0 on success
  */
-int qnonempty(int h)
+int priority_boost(int cpu)
 {
-  volatile int val = h;
-  return (h+1) != qtable[val].next;
-}
+  struct cpu *c = &cpus[cpu];
+  int target = boost_target();
+  int h = ODDHEAD(cpu), id, next;
+  uint mask;
+
+  acquire(&c->qlock);
+  for(mask = c->qmask & ~((2U << target) - 1); mask; mask &= mask - 1)
+    splice(cpu, qffs(mask), target);
+  for(id = oddtable[h].next; id != h + 1; id = next){
+    // re-enqueueing links id back in at the front of the odd list,
+    // behind the walk.
+    next = oddtable[id].next;
+    qremove(id);
+    enqueue(QHEAD(cpu, calculate_qid(id)), id);
+  }
+  release(&c->qlock);
 
-int qisempty(int h)
-{
-  if(qnonempty(h))
-    return 0;
-  return 1;
+  return 0;
 }
 
 /**
  * @brief 
- * removes & returns the last element of an array
- * 
- * @param h 
- * head index of the array you are accessing
- * @return int 
+ * moves every queued process of a cpu to its base level one by one,
+ * rebuilding the odd list. needed when the number of levels changes,
+ * since that changes every base level and boost_target() itself.
+ * @param cpu 
  */
-qentry qgetfirst(int h)
+void rebase(int cpu)
 {
-  qentry ret = qtable[qtable[h].next];
-  qtable[ret.next].prev = h;
-  qtable[h].next = ret.next;
-  return ret;
+  struct cpu *c = &cpus[cpu];
+  int target = boost_target();
+  int h = QHEAD(cpu, target), id, next;
+  uint mask;
+
+  acquire(&c->qlock);
+  for(mask = c->qmask & ~(1U << target); mask; mask &= mask - 1)
+    splice(cpu, qffs(mask), target);
+  for(id = qtable[h].next; id != h + 1; id = next){
+    next = qtable[id].next;
+    qremove(id);
+    enqueue(QHEAD(cpu, calculate_qid(id)), id);
+  }
+  release(&c->qlock);
 }
+
 /**
  * @brief 
- * removes & returns the last element of an array
- * 
- * @param h 
- * head index of the array you are accessing
- * @return int 
+ * boosts the queues of every cpu if a boost period has passed.
+ * called from the timer interrupt, and from requeue() so that processes
+ * that were not queued at boost time get boosted too.
+ * the compare-and-swap on nextboost makes exactly one caller boost
+ * per period.
  */
-qentry qgetlast(int h)
+void boost_if_due(void)
 {
-  qentry ret = qtable[qtable[h+1].prev];
-  qtable[ret.prev].next = h+1;
-  qtable[h+1].prev = ret.prev;
-  return ret;
+  uint64 due = nextboost;
+
+  if(mtime() < due)
+    return;
+  if(!__sync_bool_compare_and_swap(&nextboost, due, mtime() + boostperiod))
+    return;
+  __sync_fetch_and_add(&boostepoch, 1);
+  for(int i = 0; i < NCPU; i++)
+    priority_boost(i);
 }
+
 /**
  * @brief 
- * returns arbitrary node ind from the queue
- * @param h 
- * @param ind 
- * @return qentry 
+ * copies the MLFQ tuning parameters to user space
+ * sched_getparam(struct schedparam *sp)
+ * @return uint64 
+ * 0 on success, -1 on error
  */
-qentry qgetitem(int ind)
+uint64
+sys_sched_getparam(void)
 {
-  qentry ret = qtable[ind];
-  qtable[ret.prev].next = ret.next;
-  qtable[ret.next].prev = ret.prev;
-  return ret;
+  struct schedparam sp;
+  uint64 usp;
+
+  if(argaddr(0, &usp) < 0)
+    return -1;
+  memset(&sp, 0, sizeof(sp));
+  acquire(&param_lock);
+  sp.nqueues = nqueues;
+  for(int i = 0; i < nqueues; i++)
+    sp.quanta[i] = quanta[i];
+  sp.boost = boostperiod / TICKINTERVAL;
+  release(&param_lock);
+  return copyout(myproc()->pagetable, usp, (char *)&sp, sizeof(sp));
 }
 
 /**
  * @brief 
- * calculates the qid that a process should be added to based on its nice value
- * @param id 
- * @return int 
+ * sets the number of MLFQ levels, their quanta and the boost period.
+ * every queued process is moved to its new base level right away, so
+ * none is left on a level that is no longer in use, and a boost
+ * gives everyone a fresh quantum.
+ * sched_setparam(struct schedparam *sp)
+ * @return uint64 
+ * 0 on success, -1 if a parameter is out of range
  */
-int calculate_qid(int id)
+uint64
+sys_sched_setparam(void)
 {
-  int nice = proc[id].nice;
-  int qid;
-  if (nice <= -10) qid = 2;
-  else if (nice <= 10) qid = 1;
-  else qid = 0;
-  return qid;
+  struct schedparam sp;
+  uint64 usp;
+
+  if(argaddr(0, &usp) < 0)
+    return -1;
+  if(copyin(myproc()->pagetable, (char *)&sp, usp, sizeof(sp)) < 0)
+    return -1;
+  if(sp.nqueues < 3 || sp.nqueues > NUM_QUEUES || sp.boost < 1 || sp.boost > MAXBOOST)
+    return -1;
+  for(int i = 0; i < sp.nqueues; i++)
+    if(sp.quanta[i] < 1 || sp.quanta[i] > MAXQUANTUM)
+      return -1;
+
+  acquire(&param_lock);
+  for(int i = 0; i < sp.nqueues; i++)
+    quanta[i] = sp.quanta[i];
+  nqueues = sp.nqueues;
+  boostperiod = (uint64)sp.boost * TICKINTERVAL;
+  release(&param_lock);
+
+  for(int i = 0; i < NCPU; i++)
+    rebase(i);
+  nextboost = 0;
+  boost_if_due();
+  return 0;
 }
 
 /**
  * @brief 
- * enqueues an item to the front of the queue with head h
- * @param h 
- * id of the head of the queue
- * @param id 
- * index of the proc to insert
- * @return int 
+ * sets the harts a process may run on, bit i for cpu i. pid 0 means
+ * the caller, which moves off a hart it may no longer use at once;
+ * any other process moves the next time it is queued. a deadline
+ * class process must keep the cpu it was admitted on.
+ * setaffinity(int pid, uint64 mask)
+ * @return uint64 
+ * 0 on success, -1 if there is no such process or the mask
+ * has no online cpu
  */
-int enqueue(int h, int id)
+uint64
+sys_setaffinity(void)
 {
-  if(qtable[h].next != id && id < NPROC)
-  {
-  qtable[id].next = qtable[h].next;
-  qtable[h].next = id;
-  qtable[id].prev = h;
-  qtable[qtable[id].next].prev = id;
-  int qid = h - NPROC;
-  qid = calculate_qid(id);
-  qtable[id].queue = qid;
-  return 1;
+  int pid, move;
+  uint64 mask;
+  struct proc *p;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &mask) < 0)
+    return -1;
+  mask &= ALLCPUS;
+  if(least_loaded(mask) < 0)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  if(p->policy == SCHED_DEADLINE && !((mask >> p->dlcpu) & 1)){
+    release(&p->lock);
+    return -1;
   }
+  p->cpumask = mask;
+  release(&p->lock);
+
+  push_off();
+  move = p == myproc() && !may_run(p, cpuid());
+  pop_off();
+  if(move)
+    yield();
   return 0;
 }
 
 /**
  * @brief 
- * removes the last element of the queue
- * 
- * @param h 
- * index of the head of the queue to dequeue
- * @return int 
+ * copies the affinity mask of a process to user space.
+ * pid 0 means the caller.
+ * getaffinity(int pid, uint64 *mask)
+ * @return uint64 
+ * 0 on success, -1 on error
  */
-int dequeue(int h)
+uint64
+sys_getaffinity(void)
 {
-  qentry ret = qtable[qtable[h+1].prev];
-  int ret1 = qtable[h+1].prev;
-  qtable[h+1].prev = ret.prev;
-  qtable[ret.prev].next = h+1;
-  return ret1;
+  int pid;
+  uint64 umask, mask;
+  struct proc *p;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &umask) < 0)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  mask = p->cpumask;
+  release(&p->lock);
+  return copyout(myproc()->pagetable, umask, (char *)&mask, sizeof(mask));
 }
 
+/**
+ * @brief 
+ * makes a CPU bandwidth group whose members may together run for
+ * quota microseconds in each period. a quota of 0 means no limit.
+ * mkgroup(int quota, int period)
+ * @return uint64 
+ * the new group's id, or -1 on error
+ */
+uint64
+sys_mkgroup(void)
+{
+  int quota, period;
+  struct group *g;
+
+  if(argint(0, &quota) < 0 || argint(1, &period) < 0)
+    return -1;
+  if(quota < 0 || period < 1 || quota > period)
+    return -1;
+  for(g = &groups[1]; g < &groups[NGROUP]; g++){
+    acquire(&g->lock);
+    if(!g->inuse){
+      g->inuse = 1;
+      g->nprocs = 0;
+      g->quota = (uint64)quota * (MTIMEHZ / 1000000);
+      g->period = (uint64)period * (MTIMEHZ / 1000000);
+      g->start = mtime();
+      g->spent = g->total = g->nthrottled = 0;
+      g->throttled = 0;
+      g->parked = 0;
+      g->gang = g->nready = 0;
+      g->ready = g->readytail = 0;
+      release(&g->lock);
+      return g - groups;
+    }
+    release(&g->lock);
+  }
+  return -1;
+}
 
 /**
  * @brief 
- * enqueues an item to the front of the queue by qid
- * @param qid
- * @param id 
- * index of the proc to insert
- * @return int 
+ * removes a group that has no members left
+ * rmgroup(int gid)
+ * @return uint64 
+ * 0 on success, -1 on error
  */
-int enqueue_by_qid(int qid, int id)
+uint64
+sys_rmgroup(void)
 {
-  return enqueue(NPROC + 2 * qid, id);
+  int gid, ret = -1;
+  struct group *g;
+
+  if(argint(0, &gid) < 0 || gid < 1 || gid >= NGROUP)
+    return -1;
+  g = &groups[gid];
+  acquire(&g->lock);
+  if(g->inuse && g->nprocs == 0){
+    if(g->gang)
+      __sync_fetch_and_sub(&ngangs, 1);
+    g->inuse = g->gang = 0;
+    ret = 0;
+  }
+  release(&g->lock);
+  return ret;
 }
 
 /**
  * @brief 
- * dequeues an item from the back of the queue by qid
- * @param qid 
- * @return int 
+ * moves a process, or the caller if pid is 0, into a group.
+ * its children will be in the same group.
+ * setgroup(int pid, int gid)
+ * @return uint64 
+ * 0 on success, -1 on error
  */
-int dequeue_by_qid(int qid)
+uint64
+sys_setgroup(void)
 {
-  return dequeue(NPROC + 2 * qid);
+  int pid, gid, listed;
+  struct proc *p;
+  struct group *g, *old;
+
+  if(argint(0, &pid) < 0 || argint(1, &gid) < 0 || gid < 0 || gid >= NGROUP)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  g = &groups[gid];
+  acquire(&g->lock);
+  if(!g->inuse){
+    release(&g->lock);
+    release(&p->lock);
+    return -1;
+  }
+  g->nprocs++;
+  release(&g->lock);
+  // a parked or gang ready process is queued again in its new group.
+  old = &groups[p->group];
+  acquire(&old->lock);
+  listed = group_unlink(old, p);
+  release(&old->lock);
+  __sync_fetch_and_sub(&old->nprocs, 1);
+  p->group = gid;
+  if(listed)
+    requeue(p);
+  release(&p->lock);
+  return 0;
 }
 
 /**
  * @brief 
- * interates through each queue and boosts the priority of any process which has had its priority decreased
- * 
- * @return int 
- * returns 0 on success
+ * turns gang scheduling of a group's members on or off.
+ * members that were waiting on the gang are queued on a cpu again;
+ * queued members join the gang the next time they are queued.
+ * setgang(int gid, int on)
+ * @return uint64 
+ * 0 on success, -1 on error
  */
-int priority_boost()
-{
-  volatile qentry cur = qtable[NPROC];
-  while(cur.next != NPROC + 1)
-  {
-    if(qtable[cur.next].queue != calculate_qid(cur.next))
-    {
-      int temp = cur.next;
-      qgetitem(cur.next);
-      enqueue_by_qid(calculate_qid(temp), temp);
-      
-    }
-    cur = qtable[cur.next];
-  }
-  if(qtable[cur.next].prev != NPROC && qtable[cur.next].queue != calculate_qid(cur.next))
-  {
-    int temp = cur.next;
-    qgetitem(cur.next);
-    enqueue_by_qid(calculate_qid(temp), temp);
-  }
-  cur = qtable[NPROC + 2];
-  while(cur.next != NPROC + 3)
-  {
-    if(qtable[cur.next].queue != calculate_qid(cur.next))
-    {
-      int temp = cur.next;
-      qgetitem(cur.next);
-      enqueue_by_qid(calculate_qid(temp), temp);
-    }
-    cur = qtable[cur.next];
-  }
-  if(qtable[cur.next].prev != NPROC+2 && qtable[cur.next].queue != calculate_qid(cur.next))
-  {
-    int temp = cur.next;
-    qgetitem(cur.next);
-    enqueue_by_qid(calculate_qid(temp), temp);
-  }
-  cur = qtable[NPROC + 4];
-  while(cur.next != NPROC + 5)
-  {
-    if(qtable[cur.next].queue != calculate_qid(cur.next))
-    {
-      int temp = cur.next;
-      qgetitem(cur.next);
-      enqueue_by_qid(calculate_qid(temp), temp);
-    }
-    cur = qtable[cur.next];
+uint64
+sys_setgang(void)
+{
+  int gid, on;
+  struct group *g;
+  struct proc *p, *next;
+
+  if(argint(0, &gid) < 0 || argint(1, &on) < 0 || gid < 1 || gid >= NGROUP)
+    return -1;
+  on = on != 0;
+  g = &groups[gid];
+  acquire(&g->lock);
+  if(!g->inuse){
+    release(&g->lock);
+    return -1;
   }
-  if(qtable[cur.next].prev != NPROC + 4 && qtable[cur.next].queue != calculate_qid(cur.next))
-  {
-    int temp = cur.next;
-    qgetitem(cur.next);
-    enqueue_by_qid(calculate_qid(temp), temp);
+  if(g->gang != on)
+    __sync_fetch_and_add(&ngangs, on ? 1 : -1);
+  g->gang = on;
+  p = g->ready;
+  g->ready = g->readytail = 0;
+  g->nready = 0;
+  release(&g->lock);
+
+  // like parked ones, ready members stay RUNNABLE and on no queue,
+  // so nothing else touches them.
+  for(; p; p = next){
+    next = p->parknext;
+    acquire(&p->lock);
+    requeue(p);
+    release(&p->lock);
   }
-  
-
   return 0;
 }
 
+/**
+ * @brief 
+ * copies a group's quota and usage to user space
+ * getgroup(int gid, struct groupstat *st)
+ * @return uint64 
+ * 0 on success, -1 on error
+ */
+uint64
+sys_getgroup(void)
+{
+  int gid;
+  uint64 ust;
+  struct groupstat st;
+  struct group *g;
+
+  if(argint(0, &gid) < 0 || argaddr(1, &ust) < 0 || gid < 0 || gid >= NGROUP)
+    return -1;
+  g = &groups[gid];
+  acquire(&g->lock);
+  if(!g->inuse){
+    release(&g->lock);
+    return -1;
+  }
+  st.quota = g->quota / (MTIMEHZ / 1000000);
+  st.period = g->period / (MTIMEHZ / 1000000);
+  st.usage = g->total / (MTIMEHZ / 1000000);
+  st.nthrottled = g->nthrottled;
+  st.nprocs = g->nprocs;
+  st.throttled = g->throttled;
+  st.gang = g->gang;
+  release(&g->lock);
+  return copyout(myproc()->pagetable, ust, (char *)&st, sizeof(st));
+}
+
+/**
+ * @brief 
+ * copies the events of one cpu's ring that are newer than a cursor
+ * to user space, and advances the cursor past them.
+ * events that were overwritten before they could be read are skipped.
+ * getlog(int cpu, uint64 *cursor, struct logentry *buf, int n)
+ * @return uint64 
+ * the number of entries copied, or -1 on error
+ */
 uint64 
 sys_getlog(void) { 
-    uint64 userlog; // hold the virtual (user) address of 
-                    // user’s copy of the log 
-    // set userlog to the argument passed by the user 
-    if (argaddr(0, &userlog) < 0) 
-        return -1; 
- 
-    // copy the log from kernel memory to user memory 
+    int cpu, n, copied = 0;
+    uint64 ucursor, userlog; // hold the virtual (user) addresses of 
+                             // the cursor and user's copy of the log 
+    uint64 seq, head;
+    struct logentry e;
+    struct logring *r;
     struct proc *p = myproc(); 
-    if (copyout(p->pagetable, userlog, (char *)schedlog, 
-            sizeof(struct logentry)*LOG_SIZE) < 0) 
+
+    if (argint(0, &cpu) < 0 || argaddr(1, &ucursor) < 0 ||
+        argaddr(2, &userlog) < 0 || argint(3, &n) < 0) 
         return -1; 
+    if (cpu < 0 || cpu >= NCPU || n < 0)
+        return -1;
+    if (copyin(p->pagetable, (char *)&seq, ucursor, sizeof(seq)) < 0)
+        return -1;
+
+    r = &schedlog[cpu];
+    head = r->head;
+    __sync_synchronize();
+    // entries older than one ring back are gone
+    if (head > LOG_SIZE && seq < head - LOG_SIZE)
+        seq = head - LOG_SIZE;
+    for (; seq < head && copied < n; seq++) {
+        e = r->ent[seq & (LOG_SIZE - 1)];
+        __sync_synchronize();
+        // the writer may have wrapped around onto this entry meanwhile
+        if (r->head > seq + LOG_SIZE - 1)
+            continue;
+        if (copyout(p->pagetable, userlog + copied * sizeof(e),
+                    (char *)&e, sizeof(e)) < 0) 
+            return -1; 
+        copied++;
+    }
+    if (copyout(p->pagetable, ucursor, (char *)&seq, sizeof(seq)) < 0)
+        return -1;
  
-    return next_log_index;
+    return copied;
 } 
  
  
@@ -306,49 +2527,84 @@ sys_nice(void) {
   if (p->nice > 19) p->nice = 19;
   if (p->nice < -20) p->nice = -20;
 
-  //uint64 pindex = p - proc; 
-  //enqueue_by_qid(calculate_qid(pindex), pindex);
-  
   return p->nice;
 }
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void
-proc_mapstacks(pagetable_t kpgtbl)
+// Carve a fresh page of procs onto the free list.
+// Each new proc gets the next slot, and a page for its kernel
+// stack mapped high in memory at KSTACK(slot), followed by an
+// invalid guard page. Harts flush their TLBs for the new stacks
+// in scheduler() before running on them.
+// Caller must hold proc_lock.
+// Returns 0 if every slot is in use or memory ran out.
+static int
+growprocs(void)
 {
+  char *page, *pa;
   struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+  int n = 0;
+
+  if(nslots >= NPROC || (page = kalloc()) == 0)
+    return 0;
+  memset(page, 0, PGSIZE);
+  for(p = (struct proc*)page; (char*)(p + 1) <= page + PGSIZE && nslots < NPROC; p++){
+    if((pa = kalloc()) == 0)
+      break;
+    if(mappages(kernel_pagetable, KSTACK(nslots), PGSIZE, (uint64)pa, PTE_R | PTE_W) < 0){
+      kfree(pa);
+      break;
+    }
+    initlock(&p->lock, "proc");
+    p->slot = nslots;
+    p->kstack = KSTACK(nslots);
+    p->nextfree = freeprocs;
+    freeprocs = p;
+    proctab[nslots] = p;
+    // procdump() and wakeup() read nslots without proc_lock.
+    __sync_synchronize();
+    nslots++;
+    n++;
+  }
+  if(n == 0){
+    kfree(page);
+    return 0;
   }
+  __sync_fetch_and_add(&kstackgen, 1);
+  return 1;
 }
 
 // initialize the proc table.
 void
 procinit(void)
 {
-  struct proc *p;
-  
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->kstack = KSTACK((int) (p - proc));
+  initlock(&param_lock, "sched_param");
+  initlock(&proc_lock, "proctab");
+  initlock(&dl_lock, "dl_admit");
+  for(int i = 0; i < NGROUP; i++)
+    initlock(&groups[i].lock, "group");
+  groups[0].inuse = 1;
+  for(int i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
+
+  //hijack to initialize the per-cpu queues in qtable
+  for(int i = 0; i < NCPU; i++){
+    initlock(&cpus[i].qlock, "qlock");
+    for(int qid = 0; qid < NUM_QUEUES; qid++){
+      int h = QHEAD(i, qid);
+      qtable[h].next = h + 1;
+      qtable[h + 1].prev = h;
+    }
   }
-
-  //hijack to initialize qtable
-  qtable[NPROC].next = NPROC + 1;
-  qtable[NPROC + 1].prev = NPROC;
-  qtable[NPROC + 2].next = NPROC + 3;
-  qtable[NPROC + 3].prev = NPROC + 2;
-  qtable[NPROC + 4].next = NPROC + 5;
-  qtable[NPROC + 5].prev = NPROC + 4;
+  for(int i = 0; i < NPROC; i++)
+    qtable[i].cpu = -1;
+  for(int i = 0; i < NCPU; i++){
+    oddtable[ODDHEAD(i)].next = ODDHEAD(i) + 1;
+    oddtable[ODDHEAD(i) + 1].prev = ODDHEAD(i);
+  }
+  for(int i = 0; i < NPROC; i++)
+    oddtable[i].cpu = -1;
 }
 
 // Must be called with interrupts disabled,
@@ -382,20 +2638,68 @@ myproc(void)
   return p;
 }
 
+// Give p a new pid and enter it in the pid hash.
 int
-allocpid()
+allocpid(struct proc *p)
 {
   int pid;
   
   acquire(&pid_lock);
   pid = nextpid;
   nextpid = nextpid + 1;
+  p->pid = pid;
+  p->pidnext = pidhash[pid % NPIDHASH];
+  pidhash[pid % NPIDHASH] = p;
   release(&pid_lock);
 
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
+// Take p out of the pid hash.
+static void
+freepid(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&pid_lock);
+  for(pp = &pidhash[p->pid % NPIDHASH]; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  release(&pid_lock);
+}
+
+// Find the process with the given pid.
+// Returns it with p->lock held, or 0 if there is none.
+struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  if(pid <= 0)
+    return 0;
+  acquire(&pid_lock);
+  for(p = pidhash[pid % NPIDHASH]; p; p = p->pidnext)
+    if(p->pid == pid)
+      break;
+  release(&pid_lock);
+  if(p == 0)
+    return 0;
+
+  // p->lock comes before pid_lock, so p may have exited and
+  // been reused in between; procs are never freed, so look again.
+  acquire(&p->lock);
+  if(p->pid != pid){
+    release(&p->lock);
+    return 0;
+  }
+  return p;
+}
+
+// Take an UNUSED proc off the free list, growing the
+// process table if the list is empty.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
 // If there are no free procs, or a memory allocation fails, return 0.
@@ -404,22 +2708,33 @@ allocproc(void)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
+  acquire(&proc_lock);
+  if(freeprocs == 0 && !growprocs()){
+    release(&proc_lock);
+    return 0;
   }
-  return 0;
+  p = freeprocs;
+  freeprocs = p->nextfree;
+  release(&proc_lock);
 
-found:
-  p->pid = allocpid();
+  acquire(&p->lock);
+  allocpid(p);
   p->state = USED;
   
   // Initialize runtime of new proc to 0
   p->runtime = 0; 
+  // requeue() puts it at its base level the first time
+  p->level = 0;
+  p->boostepoch = -1;
+  p->policy = SCHED_DEFAULT;
+  p->sclass = 0;
+  p->vruntime = 0;
+  p->cpumask = ALLCPUS;
+  p->lastcpu = -1;
+  p->group = 0;
+  __sync_fetch_and_add(&groups[0].nprocs, 1);
+  p->utime = p->stime = p->wtime = p->nvcsw = p->nivcsw = 0;
+  p->cutime = p->cstime = p->cwtime = p->cnvcsw = p->cnivcsw = 0;
 
   // Initialize nice value of new proc to 0
   p->nice = 0;
@@ -461,13 +2776,25 @@ freeproc(struct proc *p)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
+  if(p->pid)
+    freepid(p);
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  if(p->policy == SCHED_DEADLINE)
+    dl_release(p);
+  p->policy = SCHED_DEFAULT;
+  __sync_fetch_and_sub(&groups[p->group].nprocs, 1);
+  p->group = 0;
   p->state = UNUSED;
+
+  acquire(&proc_lock);
+  p->nextfree = freeprocs;
+  freeprocs = p;
+  release(&proc_lock);
 }
 
 // Create a user page table for a given process,
@@ -548,9 +2875,7 @@ userinit(void)
   p->cwd = namei("/");
 
   p->state = RUNNABLE;
-  //enqueue process into the first queue addressed by NPROC
-  uint64 pindex = p - proc; 
-  enqueue_by_qid(calculate_qid(pindex), pindex);
+  requeue(p);
 
   release(&p->lock);
 }
@@ -560,15 +2885,19 @@ userinit(void)
 int
 growproc(int n)
 {
-  uint sz;
+  uint64 sz;
   struct proc *p = myproc();
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    // the pages are only allocated when they are first touched;
+    // see uvmlazy(). written so that sz + n can't wrap.
+    if(n > vmabase(p) - sz)
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
+    if(-(uint64)n > sz)
+      return -1;
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
   p->sz = sz;
@@ -596,7 +2925,21 @@ fork(void)
     return -1;
   }
   np->sz = p->sz;
+  // freeproc() unmaps the copy of [0, sz) above.
+  if(vmacopy(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
   np->nice = p->nice;
+  // a deadline class reservation isn't inherited; the child
+  // would have to be admitted on its own.
+  np->policy = p->policy == SCHED_DEADLINE ? SCHED_DEFAULT : p->policy;
+  np->vruntime = p->vruntime;
+  np->cpumask = p->cpumask;
+  __sync_fetch_and_sub(&groups[np->group].nprocs, 1);
+  np->group = p->group;
+  __sync_fetch_and_add(&groups[np->group].nprocs, 1);
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -609,6 +2952,9 @@ fork(void)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  np->exe = p->exe ? idup(p->exe) : 0;
+  memmove(np->segs, p->segs, sizeof(p->segs));
+  np->nsegs = p->nsegs;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -618,13 +2964,13 @@ fork(void)
 
   acquire(&wait_lock);
   np->parent = p;
+  np->sibling = p->children;
+  p->children = np;
   release(&wait_lock);
 
   acquire(&np->lock);
   np->state = RUNNABLE;
-  uint64 pindex = np - proc; 
-  int properQueueId = calculate_qid(pindex);
-  enqueue_by_qid(properQueueId, pindex);
+  requeue(np);
   release(&np->lock);
 
   return pid;
@@ -635,13 +2981,17 @@ fork(void)
 void
 reparent(struct proc *p)
 {
-  struct proc *pp;
+  struct proc *pp, *last = 0;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  for(pp = p->children; pp; pp = pp->sibling){
+    pp->parent = initproc;
+    last = pp;
+  }
+  if(last){
+    last->sibling = initproc->children;
+    initproc->children = p->children;
+    p->children = 0;
+    wakeup(initproc);
   }
 }
 
@@ -656,6 +3006,10 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  // Write back and drop mmap()ed regions, which hold
+  // their own references to files.
+  munmapall(p);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -667,8 +3021,12 @@ exit(int status)
 
   begin_op();
   iput(p->cwd);
+  if(p->exe)
+    iput(p->exe);
   end_op();
   p->cwd = 0;
+  p->exe = 0;
+  p->nsegs = 0;
 
   acquire(&wait_lock);
 
@@ -680,6 +3038,9 @@ exit(int status)
   
   acquire(&p->lock);
 
+  // the last stretch of cpu time counts against its group's
+  // quota like any other.
+  charge(p);
   p->xstate = status;
   p->state = ZOMBIE;
 
@@ -690,42 +3051,80 @@ exit(int status)
   panic("zombie exit");
 }
 
+// Fill in *ru with the cpu usage of p itself, of the
+// children it has waited for, or of both.
+static void
+getusage(struct proc *p, struct rusage *ru, int self, int children)
+{
+  memset(ru, 0, sizeof(*ru));
+  if(self){
+    ru->utime += p->utime;
+    ru->stime += p->stime;
+    ru->wtime += p->wtime;
+    ru->nvcsw += p->nvcsw;
+    ru->nivcsw += p->nivcsw;
+  }
+  if(children){
+    ru->utime += p->cutime;
+    ru->stime += p->cstime;
+    ru->wtime += p->cwtime;
+    ru->nvcsw += p->cnvcsw;
+    ru->nivcsw += p->cnivcsw;
+  }
+}
+
 // Wait for a child process to exit and return its pid.
+// If ruaddr is not 0, copy the child's cpu usage, including
+// its own waited-for children's, to the struct rusage there.
 // Return -1 if this process has no children.
 int
-wait(uint64 addr)
+wait(uint64 addr, uint64 ruaddr)
 {
-  struct proc *np;
+  struct rusage ru;
+  struct proc *np, **pp;
   int havekids, pid;
   struct proc *p = myproc();
 
+  // the copyouts below happen with spinlocks held.
+  if(addr)
+    uvmprefault(addr, sizeof(int));
+  if(ruaddr)
+    uvmprefault(ruaddr, sizeof(struct rusage));
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through our children looking for exited ones.
     havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      if(np->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(np);
+    for(pp = &p->children; (np = *pp) != 0; pp = &np->sibling){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+
+      havekids = 1;
+      if(np->state == ZOMBIE){
+        // Found one.
+        pid = np->pid;
+        getusage(np, &ru, 1, 1);
+        if((addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                                 sizeof(np->xstate)) < 0) ||
+           (ruaddr != 0 && copyout(p->pagetable, ruaddr, (char *)&ru,
+                                   sizeof(ru)) < 0)) {
           release(&np->lock);
           release(&wait_lock);
-          return pid;
+          return -1;
         }
+        p->cutime += ru.utime;
+        p->cstime += ru.stime;
+        p->cwtime += ru.wtime;
+        p->cnvcsw += ru.nvcsw;
+        p->cnivcsw += ru.nivcsw;
+        *pp = np->sibling;
+        np->sibling = 0;
+        freeproc(np);
         release(&np->lock);
+        release(&wait_lock);
+        return pid;
       }
+      release(&np->lock);
     }
 
     // No point waiting if we don't have any children.
@@ -741,17 +3140,31 @@ wait(uint64 addr)
 
 /**
  * @brief 
- * returns how long the quanta is for a process in a given queue
- * @param qid 
- * @return int 
+ * copies the cpu usage of the caller, or of the children it has
+ * waited for, to user space
+ * getrusage(int who, struct rusage *ru)
+ * @return uint64 
+ * 0 on success, -1 on error
  */
-int queue_quanta(int qid){
-  switch (qid){
-    case 0: return 15; 
-    case 1: return 10;
-    case 2: return 1;
-    default: return 1;
-  }
+uint64
+sys_getrusage(void)
+{
+  int who;
+  uint64 uru;
+  struct rusage ru;
+  struct proc *p = myproc();
+
+  if(argint(0, &who) < 0 || argaddr(1, &uru) < 0)
+    return -1;
+  if(who != RUSAGE_SELF && who != RUSAGE_CHILDREN)
+    return -1;
+  // bring stime up to now; the kernel time of this call so far counts.
+  push_off();
+  p->stime += mtime() - p->acctstamp;
+  p->acctstamp = mtime();
+  pop_off();
+  getusage(p, &ru, who == RUSAGE_SELF, who == RUSAGE_CHILDREN);
+  return copyout(p->pagetable, uru, (char *)&ru, sizeof(ru));
 }
 
 // Per-CPU process scheduler.
@@ -766,71 +3179,78 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
-  //int p_qid;
-  //int pid;
-  int quanta_not_elapsed = 0;
+  int me = c - cpus;
+  int id;
+  uint gen;
   c->proc = 0;
+  c->online = 1;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
-    if (time % 60 == 0){
-      quanta_not_elapsed = 0;
-      priority_boost();
-    }
-    if (quanta_not_elapsed);
-    else if (qnonempty(NPROC+4)) {
-      p = proc + dequeue_by_qid(2);
-      //p_qid = 2;
+    // work queued after this wakes us from idle() below.
+    gen = qgen;
+    __sync_synchronize();
+    // in a gang's slot its members come first.
+    id = gangcur ? gang_pick(gangcur, me) : -1;
+    if(id < 0){
+      acquire(&c->qlock);
+      id = pick_next(me);
+      release(&c->qlock);
     }
-    else if (qnonempty(NPROC+2)) {
-      p = proc + dequeue_by_qid(1);
-      //p_qid = 1;
-    }
-    else if (qnonempty(NPROC)) {
-      p = proc + dequeue_by_qid(0) ;
-      //p_qid = 0;
+
+    // nothing queued here; take work from the busiest peer,
+    // or a gang member waiting for a hart, or sleep until
+    // there is some we may run.
+    if (id < 0 && (id = steal(me)) < 0 && (id = gang_fill(me)) < 0) {
+      idle(c, gen);
+      continue;
     }
-    else continue;
+    p = proctab[id];
     acquire(&p->lock);
-    //pid = p - proc;
+    // a process whose group ran out of quota while it was
+    // queued waits for the next period instead.
+    if(p->state == RUNNABLE && group_park(p)){
+      release(&p->lock);
+      continue;
+    }
     if(p->state == RUNNABLE) {
-      //printf("\npid %d, qid %d, q_n_e %d\n", pid, p_qid, quanta_not_elapsed);
+      uint64 slice;
+
+      c->resched = 0;
+      p->lastcpu = me;
+      slice = p->sclass->dispatch(c, p);
+      // gang members run until the end of the slot, so the gang
+      // leaves its harts together, and fill-ins give them up then.
+      if(groups[p->group].gang && p->sclass != &dl_class && gangend > mtime() &&
+         (p->group == gangcur || gangend - mtime() < slice))
+        slice = gangend - mtime();
+      if(group_left(p) < slice)
+        slice = group_left(p) ? group_left(p) : 1;
 
       // Log the process switch
-      schedlog[next_log_index].pid = p->pid;
-      schedlog[next_log_index].time = ticktimer;
-      next_log_index += 1;
-      // Stop logging if buffer is full
-      if (next_log_index == LOG_SIZE) {
-        is_logging = 0;
-      }
+      log_event(p, LOG_DISPATCH);
 
       // Switch to chosen process.  It is the process's job
       // to release its lock and then reacquire it
       // before jumping back to us.
       p->state = RUNNING;
       c->proc = p;
-      swtch(&c->context, &p->context);
-      p->runtime++;
-      /* 
-      if (p->state == RUNNABLE){
-        if (p->runtime >= queue_quanta(p_qid)) {
-          if (p_qid == 0) enqueue_by_qid(0, pid);
-          else enqueue_by_qid(p_qid - 1, pid);
-          p->runtime = 0;
-          quanta_not_elapsed = 0;
-        }
-        else 
-        {
-          quanta_not_elapsed = 1;
-        }
+      // the next timer interrupt ends whatever its class gave
+      // this process to run for, rather than a fixed tick.
+      p->dispatched = mtime();
+      c->qend = p->dispatched + slice;
+      p->wtime += p->dispatched - p->enqueued;
+      p->acctstamp = p->dispatched;
+      timerset();
+      // p's kernel stack may have been mapped since this hart
+      // last flushed its TLB.
+      if(c->kstackgen != kstackgen){
+        c->kstackgen = kstackgen;
+        sfence_vma();
       }
-      else {
-        enqueue_by_qid()
-        quanta_not_elapsed = 0;
-      }
-      */
-     
+      swtch(&c->context, &p->context);
+      c->qend = 0;
+
       // Process is done running for now.
       // It should have changed its p->state before coming back.
       c->proc = 0;
@@ -862,25 +3282,50 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
+  // the scheduler starts the clock again when it next runs p.
+  p->stime += mtime() - p->acctstamp;
+
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
 }
 
-// Give up the CPU for one scheduling round.
-void
-yield(void)
+// Give up the CPU for one scheduling round, counted as a
+// voluntary or involuntary context switch.
+static void
+giveup(int involuntary)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
+  charge(p);
+  if(involuntary)
+    p->nivcsw++;
+  else
+    p->nvcsw++;
   p->state = RUNNABLE;
-  uint64 pindex = p - proc;
-  enqueue_by_qid(calculate_qid(pindex), pindex);
-  ticktimer += 1;
+  requeue(p);
+  if(involuntary)
+    log_event(p, LOG_PREEMPT);
   sched();
   release(&p->lock);
 }
 
+// Give up the CPU for one scheduling round of the process's own
+// accord, such as a system call that moved it to another queue.
+void
+yield(void)
+{
+  giveup(0);
+}
+
+// Give up the CPU because the quantum ended or another process
+// was made to preempt this one.
+void
+preempt(void)
+{
+  giveup(1);
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -909,19 +3354,33 @@ sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
   
+  struct waitq *wq = CHANQ(chan);
+  
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Once we hold chan's wait queue lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks the wait queue),
   // so it's okay to release lk.
 
+  acquire(&wq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
   // Go to sleep.
+  // the time run before blocking counts toward the quantum,
+  // so a process can't hold its level by sleeping just in time.
+  charge(p);
+  p->nvcsw++;
   p->chan = chan;
   p->state = SLEEPING;
+  p->wqprev = 0;
+  p->wqnext = wq->head;
+  if(wq->head)
+    wq->head->wqprev = p;
+  wq->head = p;
+  log_event(p, LOG_SLEEP);
+  release(&wq->lock);
 
   sched();
 
@@ -933,24 +3392,43 @@ sleep(void *chan, struct spinlock *lk)
   acquire(lk);
 }
 
+// Take p off its wait queue and make it RUNNABLE.
+// Caller must hold the lock of wq, the wait queue of p->chan,
+// and p->lock.
+static void
+wakeproc(struct waitq *wq, struct proc *p)
+{
+  if(p->wqprev)
+    p->wqprev->wqnext = p->wqnext;
+  else
+    wq->head = p->wqnext;
+  if(p->wqnext)
+    p->wqnext->wqprev = p->wqprev;
+  p->wqnext = p->wqprev = 0;
+  p->state = RUNNABLE;
+  requeue(p);
+  log_event(p, LOG_WAKE);
+}
+
 // Wake up all processes sleeping on chan.
+// Only the wait queue chan hashes to is searched.
 // Must be called without any p->lock.
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  struct waitq *wq = CHANQ(chan);
+  struct proc *p, *next;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
+  acquire(&wq->lock);
+  for(p = wq->head; p; p = next){
+    next = p->wqnext;
+    if(p->chan == chan){
       acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-        uint64 pindex = p - proc; 
-        enqueue_by_qid(calculate_qid(pindex), pindex);
-      }
+      wakeproc(wq, p);
       release(&p->lock);
     }
   }
+  release(&wq->lock);
 }
 
 // Kill the process with the given pid.
@@ -960,23 +3438,29 @@ int
 kill(int pid)
 {
   struct proc *p;
+  struct waitq *wq;
+  void *chan;
 
-  for(p = proc; p < &proc[NPROC]; p++){
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  while(p->pid == pid && p->state == SLEEPING){
+    // Wake process from sleep(). The wait queue lock comes
+    // first, so let go of p and check again once both are held.
+    chan = p->chan;
+    release(&p->lock);
+    wq = CHANQ(chan);
+    acquire(&wq->lock);
     acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-        uint64 pindex = p - proc; 
-        enqueue_by_qid(calculate_qid(pindex), pindex);
-      }
-      release(&p->lock);
-      return 0;
+    if(p->pid == pid && p->state == SLEEPING && p->chan == chan){
+      wakeproc(wq, p);
+      release(&wq->lock);
+      break;
     }
-    release(&p->lock);
+    release(&wq->lock);
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 // Copy to either a user address, or kernel address,
@@ -1026,7 +3510,8 @@ procdump(void)
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
+  for(int i = 0; i < nslots; i++){
+    p = proctab[i];
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -24,6 +24,19 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  struct spinlock qlock;      // Protects this cpu's MLFQ queues in qtable.
+  int qlen;                   // Number of processes in this cpu's queues.
+  int dlqlen;                 // How many of them are deadline class.
+  uint qmask;                 // Bit i set if this cpu's queue i is nonempty.
+  int idle;                   // Waiting in wfi() for work?
+  uint64 qend;                // mtime when the running quantum ends, or 0.
+  uint64 kstackgen;           // kstackgen as of this hart's last sfence.vma.
+  uint64 minvruntime;         // Least vruntime the fair heap has run.
+  int resched;                // Should the running process yield at once?
+  int online;                 // Has this hart started scheduling?
+  uint dlutil;                // Deadline class utilization admitted, in ppm.
+  struct proc *dlparked;      // Deadline class processes out of budget.
+  uint64 dlnext;              // Earliest dlreplenish on dlparked.
 };
 
 extern struct cpu cpus[NCPU];
@@ -81,6 +94,25 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// the part of a loadable program segment that comes from the
+// program file. exec() leaves its pages unmapped until execfault()
+// maps them; the rest of the segment is zeroed heap-like memory.
+struct execseg {
+  uint64 va;    // first address, page-aligned
+  uint64 end;   // address after its last byte from the file
+  uint off;     // offset in the file of the byte at va
+};
+
+// a region of a process's address space made by mmap().
+struct vma {
+  uint64 addr;        // page-aligned first address, or 0 if the slot is free
+  uint64 len;         // a multiple of PGSIZE
+  int prot;           // PROT_ bits
+  int flags;          // MAP_ bits
+  struct file *f;     // file it maps, or 0 if anonymous
+  uint off;           // offset in f of the byte at addr
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -92,18 +124,71 @@ struct proc {
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
   int nice;                    // Process's nice value
-  // wait_lock must be held when using this:
+  int level;                   // MLFQ level the process runs and queues at
+  uint64 runtime;              // Cycles run at this level since last level change
+  uint64 dispatched;           // mtime when last dispatched or charged
+  uint64 boostepoch;           // Boost count when level was last reset
+  uint64 enqueued;             // mtime when it last became RUNNABLE
+  int policy;                  // SCHED_ class asked for with setclass()
+  struct sched_class *sclass;  // Class it is queued or running in
+  uint64 vruntime;             // Weighted cycles run, for the fair class
+  uint64 cpumask;              // Harts it may run on, bit i for cpu i
+  int lastcpu;                 // Hart it last ran on, or -1
+  int group;                   // CPU bandwidth group it is in
+  uint64 dlruntime;            // Deadline class budget per period, in cycles
+  uint64 dldeadline;           // Deadline class relative deadline, in cycles
+  uint64 dlperiod;             // Deadline class period, in cycles
+  uint64 dlbudget;             // Cycles of budget left for the current job
+  uint64 dlabs;                // mtime of the current job's deadline
+  uint64 dlreplenish;          // mtime its budget comes back if it ran out, or 0
+  int dlcpu;                   // cpu it was admitted to the deadline class on
+  uint dlutil;                 // Utilization reserved on dlcpu, in ppm
+  // wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *children;       // First child
+  struct proc *sibling;        // Next child of the same parent
+
+  // pid_lock must be held when using this:
+  struct proc *pidnext;        // Next proc in the same pid hash bucket
+
+  // proc_lock must be held when using this:
+  struct proc *nextfree;       // Next proc on the free list
+
+  // its group's lock must be held when using this:
+  struct proc *parknext;       // Next member parked on a throttled group, or ready in a gang,
+                               // or next on its cpu's dlparked
+
+  // the lock of p->chan's wait queue must be held when using these:
+  struct proc *wqnext;         // Next sleeper in the same wait queue
+  struct proc *wqprev;         // Previous sleeper in the same wait queue
 
   // these are private to the process, so p->lock need not be held.
+  int slot;                    // Index in proctab[], qtable and KSTACK
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
+  int nsleeplocks;             // Sleep locks held
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct inode *exe;           // Program file, or 0
+  struct execseg segs[MAXSEG]; // Parts of exe mapped as they are touched
+  int nsegs;
+  struct vma vmas[NVMA];       // mmap()ed regions
   char name[16];               // Process name (debugging)
 
-  int runtime;                 // Cpu runtime since last queue level change
+  // cpu accounting from mtime. only updated by the process itself,
+  // or by the scheduler with p->lock held while p is not running.
+  uint64 acctstamp;            // mtime utime or stime was last charged up to
+  uint64 utime;                // Cycles in user mode
+  uint64 stime;                // Cycles in the kernel
+  uint64 wtime;                // Cycles RUNNABLE but waiting for a cpu
+  uint64 nvcsw;                // Voluntary context switches
+  uint64 nivcsw;               // Involuntary context switches
+  uint64 cutime;               // The same, for children it has waited for
+  uint64 cstime;
+  uint64 cwtime;
+  uint64 cnvcsw;
+  uint64 cnivcsw;
 };
@@ -256,7 +256,8 @@ r_mcounteren()
   return x;
 }
 
-// machine-mode cycle counter
+// the time CSR, a copy of the CLINT's mtime that
+// supervisor mode can read once start() allows it.
 static inline uint64
 r_time()
 {
@@ -327,6 +328,13 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// stall the hart until an interrupt is pending.
+static inline void
+wfi()
+{
+  asm volatile("wfi");
+}
+
 typedef uint64 pte_t;
 typedef uint64 *pagetable_t; // 512 PTEs
 
@@ -343,6 +351,8 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // user can access
+#define PTE_COW (1L << 8) // shared after fork(); copy before writing. an RSW bit.
+#define PTE_DIRTY (1L << 9) // written through a MAP_SHARED mapping. an RSW bit.
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -0,0 +1,12 @@
+#define RUSAGE_SELF      0   // the calling process
+#define RUSAGE_CHILDREN  1   // its children that it has waited for
+
+// cpu usage, from getrusage() and wait2().
+// times are in CLINT mtime cycles; see MTIMEHZ.
+struct rusage {
+  uint64 utime;   // cycles running in user mode
+  uint64 stime;   // cycles running in the kernel
+  uint64 wtime;   // cycles RUNNABLE but waiting for a cpu
+  uint64 nvcsw;   // voluntary context switches: sleeps and yields
+  uint64 nivcsw;  // involuntary context switches: preemptions
+};
@@ -0,0 +1,32 @@
+// Scheduler tuning parameters, shared with user space
+// by sched_getparam() and sched_setparam().
+
+#define MAXQUEUES 16  // most MLFQ levels the scheduler supports
+#define MAXQUANTUM 1000   // longest quantum sched_setparam() takes, in ticks
+#define MAXBOOST   36000  // longest boost period sched_setparam() takes, in ticks
+
+// scheduling classes for setclass(). a process in SCHED_DEFAULT
+// is in whichever class setclass(0, class) last picked.
+#define SCHED_DEFAULT 0
+#define SCHED_MLFQ    1  // multi-level feedback queue
+#define SCHED_FAIR    2  // weighted by nice, ordered by vruntime
+#define SCHED_DEADLINE 3 // earliest deadline first; see setdeadline()
+#define NSCHED        4
+
+// usage of a CPU bandwidth group, from getgroup().
+// times are in microseconds.
+struct groupstat {
+  uint64 quota;       // cpu time allowed per period, or 0 for no limit
+  uint64 period;
+  uint64 usage;       // cpu time used by its members since it was made
+  uint64 nthrottled;  // periods in which it ran out of quota
+  int nprocs;         // members
+  int throttled;      // out of quota until the period ends?
+  int gang;           // are its members gang scheduled? see setgang()
+};
+
+struct schedparam {
+  int nqueues;            // number of MLFQ levels in use, at least 3
+  int quanta[MAXQUEUES];  // quantum of each level in use, in ticks
+  int boost;              // ticks between priority boosts
+};
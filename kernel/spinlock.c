@@ -7,13 +7,70 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "lockstat.h"
+
+// counters of a lock class on one cpu. only that cpu updates
+// them, with interrupts off, so they need no lock; each gets its
+// own cache line so that the cpus don't slow each other down.
+struct lockcounts {
+  uint64 nacquire;
+  uint64 ncontended;
+  uint64 spin;
+  uint64 hold;
+  uint64 maxhold;
+} __attribute__ ((aligned (64)));
+
+// statistics are kept for each name rather than for each lock,
+// so that the many proc, pipe or sleep locks add up, and so that
+// pipe locks in freed pages still count.
+struct lockclass {
+  char *name;
+  int nlocks;
+  struct lockcounts cpu[NCPU];
+};
+
+struct lockclass lockclasses[NLOCKCLASS];
+int nlockclasses;
+
+// protects lockclasses. initlock() takes it, so it is the one
+// lock that has no class.
+struct spinlock classlock = { .name = "lockclass" };
+
+// find or make the class of locks named name.
+// returns 0 if there are already NLOCKCLASS names.
+static struct lockclass*
+lockclass(char *name)
+{
+  struct lockclass *lc;
+
+  acquire(&classlock);
+  for(lc = lockclasses; lc < &lockclasses[nlockclasses]; lc++)
+    if(strncmp(lc->name, name, LOCKNAME) == 0)
+      break;
+  if(lc == &lockclasses[NLOCKCLASS]){
+    lc = 0;
+  } else {
+    if(lc == &lockclasses[nlockclasses]){
+      lc->name = name;
+      nlockclasses++;
+    }
+    lc->nlocks++;
+  }
+  release(&classlock);
+  return lc;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
+#ifdef TICKETLOCK
+  lk->next = lk->owner = 0;
+#else
   lk->locked = 0;
+#endif
   lk->cpu = 0;
+  lk->lclass = lockclass(name);
 }
 
 // Acquire the lock.
@@ -21,16 +78,43 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 start, spun = 0;
+  int contended = 0;
+#ifdef TICKETLOCK
+  uint ticket;
+#endif
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
+#ifdef TICKETLOCK
+  // On RISC-V, sync_fetch_and_add turns into an atomic add:
+  //   amoadd.w a5, a5, (s1)
+  // waiters then only read owner, so they share its cache line
+  // until release() bumps it, instead of writing it on every try.
+  ticket = __sync_fetch_and_add(&lk->next, 1);
+  if(*(volatile uint *)&lk->owner != ticket){
+    start = r_time();
+    while(*(volatile uint *)&lk->owner != ticket)
+      ;
+    spun = r_time() - start;
+    contended = 1;
+  }
+#else
   // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
   //   a5 = 1
   //   s1 = &lk->locked
   //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  // the spin is only timed once the lock turns out to be held.
+  if(__sync_lock_test_and_set(&lk->locked, 1) != 0){
+    start = r_time();
+    while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
+      ;
+    spun = r_time() - start;
+    contended = 1;
+  }
+#endif
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +124,18 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  if(lk->lclass){
+    struct lockcounts *lc = &lk->lclass->cpu[cpuid()];
+    lc->nacquire++;
+    if(contended){
+      lc->ncontended++;
+      lc->spin += spun;
+    }
+    // the time CSR, not an uncached load of mtime from the
+    // CLINT, which would slow every acquire and release.
+    lk->acquired = r_time();
+  }
 }
 
 // Release the lock.
@@ -49,6 +145,14 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+  if(lk->lclass){
+    struct lockcounts *lc = &lk->lclass->cpu[cpuid()];
+    uint64 held = r_time() - lk->acquired;
+    lc->hold += held;
+    if(held > lc->maxhold)
+      lc->maxhold = held;
+  }
+
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,6 +163,11 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+#ifdef TICKETLOCK
+  // Serve the next ticket. Only the holder writes owner, but an
+  // atomic add keeps the store from being split or reordered.
+  __sync_fetch_and_add(&lk->owner, 1);
+#else
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -67,6 +176,7 @@ release(struct spinlock *lk)
   //   s1 = &lk->locked
   //   amoswap.w zero, zero, (s1)
   __sync_lock_release(&lk->locked);
+#endif
 
   pop_off();
 }
@@ -77,7 +187,11 @@ int
 holding(struct spinlock *lk)
 {
   int r;
+#ifdef TICKETLOCK
+  r = (lk->next != lk->owner && lk->cpu == mycpu());
+#else
   r = (lk->locked && lk->cpu == mycpu());
+#endif
   return r;
 }
 
@@ -108,3 +222,93 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// copy the statistics of up to n lock names to user space.
+// getlockstat(struct lockstat *st, int n)
+// returns the number copied, or -1 on error.
+// names keep their place, so a later call can be compared
+// entry by entry with an earlier one.
+uint64
+sys_getlockstat(void)
+{
+  uint64 ust;
+  int n, i, c;
+  struct lockstat st;
+  struct lockclass *lc;
+
+  if(argaddr(0, &ust) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  // the other cpus' counters are read without a lock, so the
+  // figures of a busy lock may be slightly out of step.
+  for(i = 0; i < n && i < nlockclasses; i++){
+    lc = &lockclasses[i];
+    memset(&st, 0, sizeof(st));
+    safestrcpy(st.name, lc->name, sizeof(st.name));
+    st.nlocks = lc->nlocks;
+    for(c = 0; c < NCPU; c++){
+      st.nacquire += lc->cpu[c].nacquire;
+      st.ncontended += lc->cpu[c].ncontended;
+      st.spin += lc->cpu[c].spin;
+      st.hold += lc->cpu[c].hold;
+      if(lc->cpu[c].maxhold > st.maxhold)
+        st.maxhold = lc->cpu[c].maxhold;
+    }
+    if(copyout(myproc()->pagetable, ust + i*sizeof(st), (char *)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return i;
+}
+
+// a lock for lockbench() to fight over.
+struct spinlock benchlock;
+int benchwaiting;      // callers waiting for the rest to arrive
+uint64 benchgen;       // number of runs started
+uint64 benchend;       // mtime the latest run ends
+uint64 benchcount;     // written in each critical section
+
+void
+lockbenchinit(void)
+{
+  initlock(&benchlock, "lockbench");
+}
+
+// acquire and release benchlock as fast as possible for ms
+// milliseconds, once n callers have arrived, so that they all
+// contend for the same stretch of time. run one caller per hart.
+// lockbench(int n, int ms)
+// returns the number of acquisitions, or -1 on error.
+uint64
+sys_lockbench(void)
+{
+  int n, ms;
+  uint64 gen, end, count = 0;
+
+  if(argint(0, &n) < 0 || argint(1, &ms) < 0 || n < 1 || ms < 0)
+    return -1;
+  acquire(&benchlock);
+  gen = benchgen;
+  if(++benchwaiting == n){
+    benchwaiting = 0;
+    benchend = mtime() + (uint64)ms * (MTIMEHZ / 1000);
+    benchgen++;
+    wakeup(&benchgen);
+  }
+  while(benchgen == gen){
+    if(myproc()->killed){
+      benchwaiting--;
+      release(&benchlock);
+      return -1;
+    }
+    sleep(&benchgen, &benchlock);
+  }
+  end = benchend;
+  release(&benchlock);
+
+  while(r_time() < end){
+    acquire(&benchlock);
+    benchcount++;
+    release(&benchlock);
+    count++;
+  }
+  return count;
+}
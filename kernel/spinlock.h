@@ -1,9 +1,19 @@
 // Mutual exclusion lock.
 struct spinlock {
+#ifdef TICKETLOCK
+  // harts take tickets and are served in order, so none can starve.
+  uint next;         // Ticket the next hart to arrive takes.
+  uint owner;        // Ticket of the holder; held unless next == owner.
+#else
   uint locked;       // Is the lock held?
+#endif
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // For getlockstat():
+  struct lockclass *lclass; // Locks with the same name, or 0.
+  uint64 acquired;   // mtime when it was acquired.
 };
 
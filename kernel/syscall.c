@@ -108,6 +108,24 @@ extern uint64 sys_uptime(void);
 extern uint64 sys_startlog(void); 
 extern uint64 sys_getlog(void); 
 extern uint64 sys_nice(void);
+extern uint64 sys_getlat(void);
+extern uint64 sys_sched_getparam(void);
+extern uint64 sys_sched_setparam(void);
+extern uint64 sys_setclass(void);
+extern uint64 sys_setdeadline(void);
+extern uint64 sys_setaffinity(void);
+extern uint64 sys_getaffinity(void);
+extern uint64 sys_mkgroup(void);
+extern uint64 sys_rmgroup(void);
+extern uint64 sys_setgroup(void);
+extern uint64 sys_getgroup(void);
+extern uint64 sys_wait2(void);
+extern uint64 sys_getrusage(void);
+extern uint64 sys_setgang(void);
+extern uint64 sys_getlockstat(void);
+extern uint64 sys_lockbench(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -135,6 +153,24 @@ static uint64 (*syscalls[])(void) = {
 [SYS_startlog] sys_startlog, 
 [SYS_getlog]  sys_getlog, 
 [SYS_nice]    sys_nice, 
+[SYS_getlat]  sys_getlat,
+[SYS_sched_getparam] sys_sched_getparam,
+[SYS_sched_setparam] sys_sched_setparam,
+[SYS_setclass] sys_setclass,
+[SYS_setdeadline] sys_setdeadline,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_getaffinity] sys_getaffinity,
+[SYS_mkgroup] sys_mkgroup,
+[SYS_rmgroup] sys_rmgroup,
+[SYS_setgroup] sys_setgroup,
+[SYS_getgroup] sys_getgroup,
+[SYS_wait2] sys_wait2,
+[SYS_getrusage] sys_getrusage,
+[SYS_setgang] sys_setgang,
+[SYS_getlockstat] sys_getlockstat,
+[SYS_lockbench] sys_lockbench,
+[SYS_mmap] sys_mmap,
+[SYS_munmap] sys_munmap,
 };
 
 void
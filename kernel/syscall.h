@@ -23,4 +23,22 @@
 //New system calls, copied from project document
 #define SYS_startlog 22 
 #define SYS_getlog   23 
-#define SYS_nice     24 
\ No newline at end of file
+#define SYS_nice     24 
+#define SYS_getlat   25
+#define SYS_sched_getparam 26
+#define SYS_sched_setparam 27
+#define SYS_setclass 28
+#define SYS_setdeadline 29
+#define SYS_setaffinity 30
+#define SYS_getaffinity 31
+#define SYS_mkgroup 32
+#define SYS_rmgroup 33
+#define SYS_setgroup 34
+#define SYS_getgroup 35
+#define SYS_wait2 36
+#define SYS_getrusage 37
+#define SYS_setgang 38
+#define SYS_getlockstat 39
+#define SYS_lockbench 40
+#define SYS_mmap 41
+#define SYS_munmap 42
\ No newline at end of file
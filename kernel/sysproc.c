@@ -35,13 +35,22 @@ sys_wait(void)
   uint64 p;
   if(argaddr(0, &p) < 0)
     return -1;
-  return wait(p);
+  return wait(p, 0);
+}
+
+uint64
+sys_wait2(void)
+{
+  uint64 p, ru;
+  if(argaddr(0, &p) < 0 || argaddr(1, &ru) < 0)
+    return -1;
+  return wait(p, ru);
 }
 
 uint64
 sys_sbrk(void)
 {
-  int addr;
+  uint64 addr;
   int n;
 
   if(argint(0, &n) < 0)
@@ -61,14 +70,21 @@ sys_sleep(void)
   if(argint(0, &n) < 0)
     return -1;
   acquire(&tickslock);
+  // hart 0 may not have taken a clock interrupt in a while.
+  ticks = mtime() / TICKINTERVAL;
   ticks0 = ticks;
+  // make hart 0 tick until we are done sleeping.
+  if(tickwaiters++ == 0)
+    ipi(0);
   while(ticks - ticks0 < n){
     if(myproc()->killed){
+      tickwaiters--;
       release(&tickslock);
       return -1;
     }
     sleep(&ticks, &tickslock);
   }
+  tickwaiters--;
   release(&tickslock);
   return 0;
 }
@@ -83,7 +99,7 @@ sys_kill(void)
   return kill(pid);
 }
 
-// return how many clock tick interrupts have occurred
+// return how many clock ticks have passed
 // since start.
 uint64
 sys_uptime(void)
@@ -91,6 +107,7 @@ sys_uptime(void)
   uint xticks;
 
   acquire(&tickslock);
+  ticks = mtime() / TICKINTERVAL;
   xticks = ticks;
   release(&tickslock);
   return xticks;
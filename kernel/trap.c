@@ -9,6 +9,7 @@
 
 struct spinlock tickslock;
 uint ticks;
+int tickwaiters; // processes sleeping on ticks; protected by tickslock
 
 extern char trampoline[], uservec[], userret[];
 
@@ -17,7 +18,7 @@ void kernelvec();
 
 extern int devintr();
 
-int time;
+extern uint64 timer_scratch[NCPU][7]; // start.c
 
 void
 trapinit(void)
@@ -50,6 +51,11 @@ usertrap(void)
 
   struct proc *p = myproc();
   
+  // the time since usertrapret() was spent in user mode.
+  uint64 now = mtime();
+  p->utime += now - p->acctstamp;
+  p->acctstamp = now;
+
   // save user program counter.
   p->trapframe->epc = r_sepc();
   
@@ -70,6 +76,13 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(r_scause() == 15 && uvmcow(p->pagetable, r_stval()) == 0){
+    // a store to a page shared since fork(), which now has its own copy.
+  } else if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+            uvmfault(p, r_stval(), r_scause() == 15) == 0){
+    // the first touch of a program page that exec() left
+    // unmapped, of a heap page that sbrk() only promised, or of
+    // an mmap()ed page, or the first store to a MAP_SHARED page.
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -79,11 +92,10 @@ usertrap(void)
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2) {
-    time++;
-    yield();
-  }
+  // give up the CPU if this timer interrupt ended the quantum,
+  // or an IPI asked for it.
+  if(which_dev != 0 && quantum_expired())
+    preempt();
   usertrapret();
 }
 
@@ -123,6 +135,11 @@ usertrapret(void)
   // set S Exception Program Counter to the saved user pc.
   w_sepc(p->trapframe->epc);
 
+  // the time since usertrap() or dispatch was spent in the kernel.
+  uint64 now = mtime();
+  p->stime += now - p->acctstamp;
+  p->acctstamp = now;
+
   // tell trampoline.S the user page table to switch to.
   uint64 satp = MAKE_SATP(p->pagetable);
 
@@ -154,28 +171,71 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // increment time if this is a timer interrupt.
-  if(which_dev == 2)
-    time++;
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-    yield();
+  // give up the CPU if this timer interrupt ended the quantum,
+  // or an IPI asked for it.
+  if(which_dev != 0 && myproc() != 0 && myproc()->state == RUNNING &&
+     quantum_expired())
+    preempt();
 
-  // the yield() may have caused some traps to occur,
+  // the preempt() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
   w_sepc(sepc);
   w_sstatus(sstatus);
 }
 
+// hart 0 only takes clock interrupts when something needs
+// one, so ticks is computed from mtime rather than counted.
 void
 clockintr()
 {
   acquire(&tickslock);
-  ticks++;
+  ticks = mtime() / TICKINTERVAL;
   wakeup(&ticks);
   release(&tickslock);
 }
 
+// the CLINT's cycle counter.
+uint64
+mtime(void)
+{
+  return *(volatile uint64*)CLINT_MTIME;
+}
+
+// program this hart's next timer interrupt for the earliest of
+// the end of the running quantum, the next priority boost if
+// anything is queued here, the replenishment of a deadline class
+// process parked here, and on hart 0 the next tick if a process
+// is sleeping on ticks, the end of the next throttled group's
+// period and the end of the gang scheduling slot. an idle hart
+// gets no timer interrupts.
+// interrupts must be disabled.
+void
+timerset(void)
+{
+  struct cpu *c = mycpu();
+  uint64 next = -1;
+
+  if(c->qend)
+    next = c->qend;
+  // a boost that is already due is done by whoever next calls
+  // boost_if_due(); arming the timer for it would only fire again
+  // and again until then.
+  if(c->qmask && nextboost > mtime() && nextboost < next)
+    next = nextboost;
+  if(dl_next() < next)
+    next = dl_next();
+  if(cpuid() == 0 && tickwaiters){
+    uint64 tick = (mtime() / TICKINTERVAL + 1) * TICKINTERVAL;
+    if(tick < next)
+      next = tick;
+  }
+  if(cpuid() == 0 && group_next() < next)
+    next = group_next();
+  if(cpuid() == 0 && gang_next() < next)
+    next = gang_next();
+  *(uint64*)CLINT_MTIMECMP(cpuid()) = next;
+}
+
 // check if it's an external interrupt or software interrupt,
 // and handle it.
 // returns 2 if timer interrupt,
@@ -209,17 +269,30 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or an IPI, forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
+    // an IPI wakes an idle hart to look for work, asks
+    // hart 0 to start ticking for a new sleeper, or asks the
+    // running process to yield to one that preempts it.
+    if(__sync_lock_test_and_set(&timer_scratch[cpuid()][6], 0) == 0){
+      timerset();
+      return 1;
+    }
+
+    if(cpuid() == 0){
+      clockintr();
+      group_refill();
+      gang_rotate();
+    }
+    boost_if_due();
+    dl_replenish();
+    timerset();
+
     return 2;
   } else {
     return 0;
@@ -5,6 +5,8 @@
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
+#include "spinlock.h"
+#include "proc.h"
 
 /*
  * the kernel's page table.
@@ -33,6 +35,9 @@ kvmmake(void)
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
+  // CLINT, for sending IPIs to other harts
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
@@ -43,9 +48,9 @@ kvmmake(void)
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // allocate and map a kernel stack for each process.
-  proc_mapstacks(kpgtbl);
-  
+  // kernel stacks are mapped by growprocs() in proc.c,
+  // as processes are first allocated.
+
   return kpgtbl;
 }
 
@@ -160,7 +165,8 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that were never mapped, like heap pages
+// sbrk() handed out that were never touched, are skipped.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
@@ -172,10 +178,14 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
+    // a lazily grown heap may be mostly holes; skip the rest
+    // of a 2MB range that has no page-table page at all.
+    if((pte = walk(pagetable, a, 0)) == 0){
+      a = PGROUNDDOWN(a | ((1L << PXSHIFT(1)) - 1));
+      continue;
+    }
     if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -291,42 +301,203 @@ uvmfree(pagetable_t pagetable, uint64 sz)
   freewalk(pagetable);
 }
 
-// Given a parent process's page table, copy
-// its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Given a parent process's page table, share
+// its memory with a child's page table.
+// Copies the page table, but maps the same
+// physical pages. Writable pages become read-only
+// PTE_COW pages in both, and are copied by uvmcow()
+// when either process first writes one.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+{
+  return uvmcopyrange(old, new, 0, sz, 0);
+}
+
+// Like uvmcopy(), for the pages in [start, end). If share is set,
+// as for a MAP_SHARED mapping, writable pages stay writable in
+// both instead of becoming copy-on-write.
+int
+uvmcopyrange(pagetable_t old, pagetable_t new, uint64 start, uint64 end, int share)
 {
   pte_t *pte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+  for(i = start; i < end; i += PGSIZE){
+    // an untouched page stays untouched in the child too.
+    if((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
+    if(!share && (*pte & PTE_W))
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+    // a dirty page is written back by the parent; the child's
+    // first store faults to mark its own PTE dirty.
+    if(flags & PTE_DIRTY)
+      flags &= ~(PTE_DIRTY|PTE_W);
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    }
+    kref((void*)pa);
   }
+  // the parent's stale writable TLB entries are flushed by
+  // the sfence.vma in userret on its way back to user space.
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
   return -1;
 }
 
+// Give a process its own writable copy of the PTE_COW page
+// at va, before it writes to it. The last process sharing a page
+// just takes it over.
+// returns 0 on success, -1 if va is not a COW page
+// or there is no memory for the copy.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walk(pagetable, va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(krefs((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, (char*)pa, PGSIZE);
+    *pte = PA2PTE(mem) | flags;
+    kfree((void*)pa);
+  }
+  // userret's sfence.vma drops any stale read-only TLB entry.
+  return 0;
+}
+
+// Map a zeroed page at va, a heap page below sz that
+// sbrk() handed out but that was never touched until now.
+// returns 0 on success, -1 if va is not such a page
+// or there is no memory for it.
+int
+uvmlazy(pagetable_t pagetable, uint64 sz, uint64 va)
+{
+  pte_t *pte;
+  char *mem;
+
+  if(va >= sz)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walk(pagetable, va, 0)) != 0 && (*pte & PTE_V))
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Map the page at va that a process touched for the first time:
+// a page of its program, of its heap, or of an mmap()ed region,
+// or let it write a MAP_SHARED page. write is set for a store.
+// returns 0 on success, -1 if va is not such a page
+// or it can't be mapped.
+int
+uvmfault(struct proc *p, uint64 va, int write)
+{
+  struct execseg *s;
+  struct vma *v;
+
+  if((v = vmalookup(p, va)) != 0)
+    return vmafault(p, v, va, write);
+  if(va >= p->sz)
+    return -1;
+  if((s = execseg(p, va)) != 0)
+    return execfault(p, s, va);
+  return uvmlazy(p->pagetable, p->sz, va);
+}
+
+// Map the untouched pages of [start, end) that also lie in the
+// buffer at [va, va+len).
+static void
+uvmprefaultrange(struct proc *p, uint64 va, uint64 len, uint64 start, uint64 end)
+{
+  uint64 a;
+
+  if(start < va)
+    start = va;
+  if(end > va + len)
+    end = va + len;
+  for(a = PGROUNDDOWN(start); a < end; a += PGSIZE)
+    if(walkaddr(p->pagetable, a) == 0)
+      uvmfault(p, a, 0);
+}
+
+// Map every untouched page of a file, of the program or of an
+// mmap()ed file, in the current process's buffer at [va, va+len),
+// for callers that go on to copy it holding a lock, when uvmaddr()
+// won't read a file page in. Other pages are mapped by the copy
+// itself, so only those that are actually copied get allocated.
+// Pages that can't be mapped are left for copyin/copyout to fail on.
+void
+uvmprefault(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  struct execseg *s;
+  struct vma *v;
+
+  if(len == 0 || va >= TRAPFRAME)
+    return;
+  if(len > TRAPFRAME - va)
+    len = TRAPFRAME - va;
+  for(s = p->segs; s < &p->segs[p->nsegs]; s++)
+    uvmprefaultrange(p, va, len, s->va, s->end);
+  for(v = p->vmas; v < &p->vmas[NVMA]; v++)
+    if(v->addr && v->f)
+      uvmprefaultrange(p, va, len, v->addr, v->addr + v->len);
+}
+
+// Look up the physical address of the current process's page
+// at va like walkaddr(), but map it first if it was never touched,
+// since the kernel doesn't take page faults on user addresses.
+// Pages of files are only read in if no lock is held: reading
+// sleeps, so not under a spinlock, and it locks the file's inode, so
+// not under a sleep lock, which may be another inode's; a process
+// reading the files the other way around would deadlock with us.
+// Return 0 if it is not mapped and can't be.
+static uint64
+uvmaddr(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 pa;
+  int nolocks, file;
+
+  pa = walkaddr(pagetable, va);
+  if(pa != 0 || p == 0 || p->pagetable != pagetable)
+    return pa;
+  push_off();
+  nolocks = mycpu()->noff == 1 && p->nsleeplocks == 0;
+  pop_off();
+  file = execseg(p, va) != 0 || ((v = vmalookup(p, va)) != 0 && v->f != 0);
+  if((nolocks || !file) && uvmfault(p, va, 0) == 0)
+    pa = walkaddr(pagetable, va);
+  return pa;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -347,12 +518,27 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
+    // the kernel writes through the physical address, so it has
+    // to break the sharing of a COW page itself, and mark a
+    // MAP_SHARED page dirty.
+    pte = walk(pagetable, va0, 0);
+    if((*pte & PTE_W) == 0){
+      if(*pte & PTE_COW){
+        if(uvmcow(pagetable, va0) < 0)
+          return -1;
+      } else if(myproc() == 0 || myproc()->pagetable != pagetable ||
+                uvmfault(myproc(), va0, 1) < 0){
+        return -1;
+      }
+      pa0 = walkaddr(pagetable, va0);
+    }
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -375,7 +561,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -402,7 +588,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -0,0 +1,74 @@
+/**
+ * @file forkbench.c
+ * @brief 
+ * Stresses the page allocator the way forktest and usertests do:
+ * NPROC workers each fork children that exec a tiny program, while
+ * growing and shrinking their own memory, for a number of seconds.
+ * Run it at different -smp counts to see how allocation scales, or
+ * under lockstat to see how often kmem and kcache were contended.
+ * forkbench [NPROC [SECONDS]]
+ * 
+ */
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+#define GROW (16 * 4096)   // bytes each round sbrk()s and gives back
+
+int main(int argc, char *argv[])
+{
+    int nproc, secs, fds[2], i, status;
+    uint64 rounds, total = 0;
+    char *args[] = { argv[0], "-x", 0 };
+
+    // the exec()ed child; its whole job is to be set up and torn down.
+    if(argc == 2 && strcmp(argv[1], "-x") == 0)
+        exit(0);
+
+    nproc = argc > 1 ? atoi(argv[1]) : NCPU;
+    secs = argc > 2 ? atoi(argv[2]) : 5;
+    if(nproc < 1 || secs < 1){
+        printf("Expected forkbench [NPROC [SECONDS]]\n");
+        exit(1);
+    }
+    if(pipe(fds) < 0){
+        printf("forkbench: pipe failed\n");
+        exit(1);
+    }
+    for(i = 0; i < nproc; i++){
+        int pid = fork();
+        if(pid < 0){
+            printf("forkbench: fork failed\n");
+            exit(1);
+        }
+        if(pid == 0){
+            // uptime() counts ticks of about 1/10th of a second.
+            int end = uptime() + secs * 10;
+            close(fds[0]);
+            for(rounds = 0; uptime() < end; rounds++){
+                int child = fork();
+                if(child < 0)
+                    break;
+                if(child == 0){
+                    exec(args[0], args);
+                    exit(1);
+                }
+                if(sbrk(GROW) != (char *)-1)
+                    sbrk(-GROW);
+                wait(&status);
+            }
+            write(fds[1], &rounds, sizeof(rounds));
+            exit(0);
+        }
+    }
+    close(fds[1]);
+    for(i = 0; i < nproc; i++){
+        if(read(fds[0], &rounds, sizeof(rounds)) == sizeof(rounds))
+            total += rounds;
+        wait(&status);
+    }
+    printf("%d workers: %l fork/exec/exit rounds, %l per second\n",
+           nproc, total, total / secs);
+    exit(0);
+}
@@ -0,0 +1,74 @@
+/**
+ * @file group.c
+ * @brief 
+ * Manages CPU bandwidth groups. Times are in microseconds.
+ * group                          prints the usage of every group
+ * group new QUOTA PERIOD         makes a group and prints its id
+ * group rm GID                   removes a group with no members
+ * group move GID PID             moves a process into a group
+ * group run GID PROG [ARG] ...   runs a command in a group
+ * group gang GID on|off          gang schedules a group's members
+ * 
+ */
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+int main(int argc, char *argv[])
+{
+    struct groupstat st;
+    int gid;
+
+    if(argc == 1){
+        printf("gid procs quota period usage throttled gang\n");
+        for(gid = 0; gid < NGROUP; gid++){
+            if(getgroup(gid, &st) < 0)
+                continue;
+            printf("%d %d %l %l %l %l%s %s\n", gid, st.nprocs, st.quota, st.period,
+                   st.usage, st.nthrottled, st.throttled ? " (now)" : "", st.gang ? "yes" : "no");
+        }
+        exit(0);
+    }
+    if(argc == 4 && strcmp(argv[1], "new") == 0){
+        if((gid = mkgroup(atoi(argv[2]), atoi(argv[3]))) < 0){
+            printf("group: can't make a group with quota %s and period %s\n", argv[2], argv[3]);
+            exit(1);
+        }
+        printf("%d\n", gid);
+        exit(0);
+    }
+    if(argc == 3 && strcmp(argv[1], "rm") == 0){
+        if(rmgroup(atoi(argv[2])) < 0){
+            printf("group: can't remove group %s\n", argv[2]);
+            exit(1);
+        }
+        exit(0);
+    }
+    if(argc == 4 && strcmp(argv[1], "move") == 0){
+        if(setgroup(atoi(argv[3]), atoi(argv[2])) < 0){
+            printf("group: can't move pid %s to group %s\n", argv[3], argv[2]);
+            exit(1);
+        }
+        exit(0);
+    }
+    if(argc >= 4 && strcmp(argv[1], "run") == 0){
+        if(setgroup(0, atoi(argv[2])) < 0){
+            printf("group: no group %s\n", argv[2]);
+            exit(1);
+        }
+        exec(argv[3], &argv[3]);
+        printf("group: exec %s failed\n", argv[3]);
+        exit(1);
+    }
+    if(argc == 4 && strcmp(argv[1], "gang") == 0){
+        if(setgang(atoi(argv[2]), strcmp(argv[3], "on") == 0) < 0){
+            printf("group: no group %s\n", argv[2]);
+            exit(1);
+        }
+        exit(0);
+    }
+    printf("Expected group [new QUOTA PERIOD | rm GID | move GID PID | run GID PROG [ARG] ... | gang GID on|off]\n");
+    exit(1);
+}
@@ -0,0 +1,79 @@
+/**
+ * @file lockbench.c
+ * @brief 
+ * Measures spinlock throughput and fairness: one process per hart,
+ * each pinned to its hart, fights over a kernel lock for a while.
+ * Build the kernel with LOCK=ticket or LOCK=tas to compare them.
+ * lockbench [NCPU [MS]]
+ * 
+ */
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+int main(int argc, char *argv[])
+{
+    int ncpu = argc > 1 ? atoi(argv[1]) : NCPU;
+    int ms = argc > 2 ? atoi(argv[2]) : 1000;
+    int fds[2], i, status;
+    uint64 count[NCPU], total = 0, sumsq = 0, min = -1, max = 0;
+
+    if(ncpu < 1 || ncpu > NCPU || ms < 1){
+        printf("Expected lockbench [NCPU [MS]] with 1 <= NCPU <= %d\n", NCPU);
+        exit(1);
+    }
+    if(pipe(fds) < 0){
+        printf("lockbench: pipe failed\n");
+        exit(1);
+    }
+    for(i = 0; i < ncpu; i++){
+        int pid = fork();
+        if(pid < 0){
+            printf("lockbench: fork failed\n");
+            exit(1);
+        }
+        if(pid == 0){
+            uint64 n;
+            close(fds[0]);
+            if(setaffinity(0, 1ULL << i) < 0){
+                printf("lockbench: can't run on hart %d\n", i);
+                exit(1);
+            }
+            n = lockbench(ncpu, ms);
+            write(fds[1], &i, sizeof(i));
+            write(fds[1], &n, sizeof(n));
+            exit(0);
+        }
+    }
+    close(fds[1]);
+    for(i = 0; i < ncpu; i++){
+        int cpu;
+        uint64 n;
+        if(read(fds[0], &cpu, sizeof(cpu)) != sizeof(cpu) || read(fds[0], &n, sizeof(n)) != sizeof(n)){
+            printf("lockbench: a worker failed\n");
+            exit(1);
+        }
+        count[cpu] = n;
+    }
+    for(i = 0; i < ncpu; i++)
+        wait(&status);
+
+    printf("hart acquisitions\n");
+    for(i = 0; i < ncpu; i++){
+        printf("%d %l\n", i, count[i]);
+        total += count[i];
+        sumsq += count[i] * count[i];
+        if(count[i] < min)
+            min = count[i];
+        if(count[i] > max)
+            max = count[i];
+    }
+    printf("total %l, %l per second\n", total, total * 1000 / ms);
+    // Jain's index is 1000 when every hart got the same share,
+    // and 1000/NCPU when one hart got all of it.
+    if(total)
+        printf("fairness: min/max %l/1000, Jain's index %l/1000\n",
+               max ? min * 1000 / max : 0, total * total * 1000 / (ncpu * sumsq));
+    exit(0);
+}
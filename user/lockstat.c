@@ -0,0 +1,83 @@
+/**
+ * @file lockstat.c
+ * @brief 
+ * Prints the spinlocks that were most often found held, by name.
+ * Times are in microseconds.
+ * lockstat [-n N]                  since boot
+ * lockstat [-n N] PROG [ARG] ...   while a command runs
+ * 
+ */
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+#define CYCLES_PER_US (MTIMEHZ / 1000000)
+
+struct lockstat before[NLOCKCLASS], after[NLOCKCLASS];
+int order[NLOCKCLASS];
+
+// does lock a rank above lock b? by contended acquisitions,
+// then by time spent spinning.
+int above(struct lockstat *a, struct lockstat *b)
+{
+    if(a->ncontended != b->ncontended)
+        return a->ncontended > b->ncontended;
+    return a->spin > b->spin;
+}
+
+int main(int argc, char *argv[])
+{
+    int i, j, n, top = 10, status;
+    int arg = 1;
+
+    if(argc >= 3 && strcmp(argv[1], "-n") == 0){
+        top = atoi(argv[2]);
+        arg = 3;
+    }
+    if(arg < argc){
+        if(getlockstat(before, NLOCKCLASS) < 0){
+            printf("lockstat: getlockstat failed\n");
+            exit(1);
+        }
+        int pid = fork();
+        if(pid < 0){
+            printf("lockstat: fork failed\n");
+            exit(1);
+        }
+        if(pid == 0){
+            exec(argv[arg], &argv[arg]);
+            printf("lockstat: exec %s failed\n", argv[arg]);
+            exit(1);
+        }
+        wait(&status);
+    }
+    if((n = getlockstat(after, NLOCKCLASS)) < 0){
+        printf("lockstat: getlockstat failed\n");
+        exit(1);
+    }
+    // names keep their place, so the counts while the command ran
+    // are the differences. the longest hold is since boot.
+    for(i = 0; i < n; i++){
+        after[i].nacquire -= before[i].nacquire;
+        after[i].ncontended -= before[i].ncontended;
+        after[i].spin -= before[i].spin;
+        after[i].hold -= before[i].hold;
+    }
+
+    for(i = 0; i < n; i++){
+        for(j = i; j > 0 && above(&after[i], &after[order[j-1]]); j--)
+            order[j] = order[j-1];
+        order[j] = i;
+    }
+
+    printf("name locks acquired contended spin hold maxhold\n");
+    for(i = 0; i < n && i < top; i++){
+        struct lockstat *st = &after[order[i]];
+        printf("%s %l %l %l %l %l %l\n", st->name, st->nlocks, st->nacquire,
+               st->ncontended, st->spin / CYCLES_PER_US, st->hold / CYCLES_PER_US,
+               st->maxhold / CYCLES_PER_US);
+    }
+    exit(0);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file schedlat.c
+ * @brief 
+ * Prints how long runnable processes waited for a cpu, per MLFQ level.
+ * schedlat [cpu]
+ * With no cpu the histograms of all cpus are added together.
+ * 
+ */
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "user/user.h"
+#include "kernel/log.h"
+
+uint64 hist[LAT_LEVELS][LAT_BUCKETS];
+uint64 total[LAT_LEVELS][LAT_BUCKETS];
+
+/**
+ * @brief 
+ * finds the bucket holding a percentile of a histogram
+ * @param h 
+ * @param n 
+ * number of samples in h
+ * @param pct 
+ * @return int 
+ * the bucket index
+ */
+int percentile(uint64 *h, uint64 n, int pct){
+    uint64 want = (n * pct + 99) / 100;
+    uint64 seen = 0;
+    for (int b = 0; b < LAT_BUCKETS; b++){
+        seen += h[b];
+        if (seen >= want)
+            return b;
+    }
+    return LAT_BUCKETS - 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int levels = 0, first = 0, last = NCPU - 1;
+
+    if (argc > 1){
+        first = last = atoi(argv[1]);
+    }
+    for (int cpu = first; cpu <= last; cpu++){
+        if ((levels = getlat(cpu, &hist[0][0])) < 0){
+            printf("schedlat: bad cpu %d\n", cpu);
+            exit(1);
+        }
+        for (int q = 0; q < levels; q++)
+            for (int b = 0; b < LAT_BUCKETS; b++)
+                total[q][b] += hist[q][b];
+    }
+
+    // buckets are reported by their upper bound in cycles
+    for (int q = 0; q < levels; q++){
+        uint64 n = 0;
+        for (int b = 0; b < LAT_BUCKETS; b++)
+            n += total[q][b];
+        if (n == 0){
+            printf("queue %d: no dispatches\n", q);
+            continue;
+        }
+        printf("queue %d: %l dispatches, p50 < %l cycles, p99 < %l cycles\n", q, n,
+            (uint64)1 << (percentile(total[q], n, 50) + 1),
+            (uint64)1 << (percentile(total[q], n, 99) + 1));
+        for (int b = 0; b < LAT_BUCKETS; b++)
+            if (total[q][b])
+                printf("  < %l: %l\n", (uint64)1 << (b + 1), total[q][b]);
+    }
+    exit(0);
+}
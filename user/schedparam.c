@@ -0,0 +1,42 @@
+/**
+ * @file schedparam.c
+ * @brief 
+ * Shows or sets the MLFQ tuning parameters.
+ * schedparam                      prints the current parameters
+ * schedparam BOOST Q0 Q1 Q2 ...   sets the boost period and one quantum
+ *                                 per level, all in ticks
+ * 
+ */
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+int main(int argc, char *argv[])
+{
+    struct schedparam sp;
+
+    if(argc == 1){
+        if(sched_getparam(&sp) < 0){
+            printf("schedparam: sched_getparam failed\n");
+            exit(1);
+        }
+        printf("boost every %d ticks, %d levels\n", sp.boost, sp.nqueues);
+        for(int i = 0; i < sp.nqueues; i++)
+            printf("queue %d: %d ticks\n", i, sp.quanta[i]);
+        exit(0);
+    }
+    if(argc < 5 || argc - 2 > MAXQUEUES){
+        printf("Expected schedparam BOOST Q0 Q1 Q2 ... with 3 to %d quanta\n", MAXQUEUES);
+        exit(1);
+    }
+    sp.boost = atoi(argv[1]);
+    sp.nqueues = argc - 2;
+    for(int i = 0; i < sp.nqueues; i++)
+        sp.quanta[i] = atoi(argv[i + 2]);
+    if(sched_setparam(&sp) < 0){
+        printf("schedparam: invalid parameters\n");
+        exit(1);
+    }
+    exit(0);
+}
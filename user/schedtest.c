@@ -7,22 +7,48 @@
  */
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/param.h"
 #include "user/user.h"
 #include "kernel/log.h"
 
+char *events[] = {
+  [LOG_DISPATCH] "dispatch",
+  [LOG_PREEMPT]  "preempt",
+  [LOG_SLEEP]    "sleep",
+  [LOG_WAKE]     "wake",
+  [LOG_BOOST]    "boost",
+  [LOG_DEMOTE]   "demote",
+  [LOG_DLMISS]   "dlmiss",
+};
+
+/**
+ * @brief 
+ * prints every event still in the log of each cpu
+ */
+void printlog(){
+    struct logentry log[32];
+    for (int cpu = 0; cpu < NCPU; cpu++){
+        uint64 cursor = 0;
+        int n;
+        while ((n = getlog(cpu, &cursor, &log[0], 32)) > 0){
+            for (int i=0; i < n; i++){
+                printf("pid %d, time %l, cpu %d, queue %d, %s\n",
+                    log[i].pid, log[i].time, log[i].cpu, log[i].queue,
+                    events[log[i].event]);
+            }
+        }
+    }
+}
+
 void test1(){
     fork();
     nice(-19);
-    struct logentry log[100];
     uint64 acc = 0; 
     startlog();
     for (uint64 i=0; i<900000000; i++) {  
         acc += 1;  
     }
-    int n = getlog(&log[0]);
-    for (int i=0; i < n; i++){
-        printf("pid %d, time %d\n", log[i].pid, log[i].time);
-    }
+    printlog();
     printf("acc %d\n", acc);
     exit(0);
 }
@@ -30,7 +56,6 @@ void test1(){
 void test2(){
     int f = fork();
     nice(-19);
-    struct logentry log[100];
     uint64 acc = 0; 
     startlog();
     if (f != 0) {
@@ -44,10 +69,7 @@ void test2(){
             acc += 1;
         } 
     }
-    int n = getlog(&log[0]);
-    for (int i=0; i < n; i++){
-        printf("pid %d, time %d\n", log[i].pid, log[i].time);
-    }
+    printlog();
     printf("acc %d\n", acc);
     exit(0);
 }
@@ -71,4 +93,3 @@ int main(int argc, char *argv[])
     }
     exit(0);
 }
-
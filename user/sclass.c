@@ -0,0 +1,74 @@
+/**
+ * @file sclass.c
+ * @brief 
+ * Shows or sets scheduling classes.
+ * sclass                      prints the class of SCHED_DEFAULT processes
+ * sclass CLASS                sets the class of SCHED_DEFAULT processes
+ * sclass CLASS PID            sets the class of one process
+ * sclass CLASS CMD ARGS ...   runs a command in a class
+ * sclass deadline RUNTIME DEADLINE PERIOD CMD ARGS ...
+ *                             runs a command in the deadline class,
+ *                             with times in microseconds
+ * CLASS is one of default, mlfq or fair.
+ * 
+ */
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+static char *names[NSCHED] = {
+    [SCHED_DEFAULT] "default",
+    [SCHED_MLFQ]    "mlfq",
+    [SCHED_FAIR]    "fair",
+    [SCHED_DEADLINE] "deadline",
+};
+
+int main(int argc, char *argv[])
+{
+    int class;
+
+    if(argc == 1){
+        class = setclass(0, -1);
+        printf("%s\n", class >= 0 && class < NSCHED ? names[class] : "?");
+        exit(0);
+    }
+    for(class = 0; class < NSCHED; class++)
+        if(strcmp(argv[1], names[class]) == 0)
+            break;
+    if(class == NSCHED){
+        printf("Expected sclass [default|mlfq|fair [PID | CMD ARGS ...]]\n");
+        exit(1);
+    }
+    if(class == SCHED_DEADLINE){
+        if(argc < 6){
+            printf("Expected sclass deadline RUNTIME DEADLINE PERIOD CMD ARGS ...\n");
+            exit(1);
+        }
+        if(setdeadline(atoi(argv[2]), atoi(argv[3]), atoi(argv[4])) < 0){
+            printf("sclass: deadline parameters not admitted\n");
+            exit(1);
+        }
+        exec(argv[5], argv + 5);
+        printf("sclass: exec %s failed\n", argv[5]);
+        exit(1);
+    }
+    if(argc == 2){
+        if(setclass(0, class) < 0){
+            printf("sclass: the system class can't be default\n");
+            exit(1);
+        }
+        exit(0);
+    }
+    if(argv[2][0] >= '0' && argv[2][0] <= '9'){
+        if(setclass(atoi(argv[2]), class) < 0){
+            printf("sclass: no process %s\n", argv[2]);
+            exit(1);
+        }
+        exit(0);
+    }
+    setclass(getpid(), class);
+    exec(argv[2], argv + 2);
+    printf("sclass: exec %s failed\n", argv[2]);
+    exit(1);
+}
@@ -0,0 +1,73 @@
+/**
+ * @file taskset.c
+ * @brief 
+ * Shows or sets the harts a process may run on.
+ * MASK is a hex bitmask with bit i for cpu i, as in 0x5 for cpus 0 and 2.
+ * taskset MASK PROG [ARG] ...   runs a command on the harts in MASK
+ * taskset -p PID                prints the mask of a process
+ * taskset -p MASK PID           sets the mask of a process
+ * 
+ */
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+/**
+ * @brief 
+ * parses a hex mask, with or without a leading 0x
+ * @param s 
+ * @return uint64 
+ * the mask, or 0 if s is not hex
+ */
+uint64 parsemask(char *s)
+{
+    uint64 mask = 0;
+
+    if(s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+        s += 2;
+    if(*s == 0)
+        return 0;
+    for(; *s; s++){
+        if(*s >= '0' && *s <= '9')
+            mask = mask * 16 + *s - '0';
+        else if(*s >= 'a' && *s <= 'f')
+            mask = mask * 16 + *s - 'a' + 10;
+        else if(*s >= 'A' && *s <= 'F')
+            mask = mask * 16 + *s - 'A' + 10;
+        else
+            return 0;
+    }
+    return mask;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64 mask;
+
+    if(argc == 3 && strcmp(argv[1], "-p") == 0){
+        if(getaffinity(atoi(argv[2]), &mask) < 0){
+            printf("taskset: no process %s\n", argv[2]);
+            exit(1);
+        }
+        printf("pid %s's affinity mask: %x\n", argv[2], (int)mask);
+        exit(0);
+    }
+    if(argc == 4 && strcmp(argv[1], "-p") == 0){
+        if(setaffinity(atoi(argv[3]), parsemask(argv[2])) < 0){
+            printf("taskset: can't set pid %s's mask to %s\n", argv[3], argv[2]);
+            exit(1);
+        }
+        exit(0);
+    }
+    if(argc < 3){
+        printf("Expected taskset MASK PROG [ARG] ... or taskset -p [MASK] PID\n");
+        exit(1);
+    }
+    if(setaffinity(0, parsemask(argv[1])) < 0){
+        printf("taskset: no online cpu in mask %s\n", argv[1]);
+        exit(1);
+    }
+    exec(argv[2], &argv[2]);
+    printf("taskset: exec %s failed\n", argv[2]);
+    exit(1);
+}
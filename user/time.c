@@ -0,0 +1,47 @@
+/**
+ * @file time.c
+ * @brief 
+ * Runs a command and reports the cpu time it used.
+ * time PROG [ARG] ...
+ * 
+ */
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/rusage.h"
+#include "user/user.h"
+
+#define CYCLES_PER_MS (MTIMEHZ / 1000)
+
+int main(int argc, char *argv[])
+{
+    struct rusage ru;
+    int pid, status, start;
+
+    if(argc < 2){
+        printf("Expected time PROG [ARG] ...\n");
+        exit(1);
+    }
+    start = uptime();
+    pid = fork();
+    if(pid < 0){
+        printf("time: fork failed\n");
+        exit(1);
+    }
+    if(pid == 0){
+        exec(argv[1], &argv[1]);
+        printf("time: exec %s failed\n", argv[1]);
+        exit(1);
+    }
+    if(wait2(&status, &ru) < 0){
+        printf("time: wait failed\n");
+        exit(1);
+    }
+    // uptime() counts ticks of TICKINTERVAL cycles
+    printf("real %l ms\n", (uint64)(uptime() - start) * TICKINTERVAL / CYCLES_PER_MS);
+    printf("user %l ms\n", ru.utime / CYCLES_PER_MS);
+    printf("sys  %l ms\n", ru.stime / CYCLES_PER_MS);
+    printf("wait %l ms\n", ru.wtime / CYCLES_PER_MS);
+    printf("%l voluntary, %l involuntary context switches\n", ru.nvcsw, ru.nivcsw);
+    exit(status);
+}
@@ -1,6 +1,10 @@
 struct stat;
 struct rtcdate;
 struct logentry;
+struct schedparam;
+struct groupstat;
+struct rusage;
+struct lockstat;
 
 // system calls
 int fork(void);
@@ -25,8 +29,26 @@ char* sbrk(int);
 int sleep(int);
 int uptime(void);
 int startlog(void);
-int getlog(struct logentry*);
+int getlog(int cpu, uint64 *cursor, struct logentry*, int n);
 int nice(int inc);
+int getlat(int cpu, uint64 *hist);
+int sched_getparam(struct schedparam*);
+int sched_setparam(struct schedparam*);
+int setclass(int pid, int class);
+int setdeadline(int runtime, int deadline, int period);
+int setaffinity(int pid, uint64 mask);
+int getaffinity(int pid, uint64 *mask);
+int mkgroup(int quota, int period);
+int rmgroup(int gid);
+int setgroup(int pid, int gid);
+int getgroup(int gid, struct groupstat*);
+int wait2(int*, struct rusage*);
+int getrusage(int who, struct rusage*);
+int setgang(int, int);
+int getlockstat(struct lockstat*, int);
+int lockbench(int, int);
+void* mmap(void*, uint64, int, int, int, uint64);
+int munmap(void*, uint64);
 
 
 // ulib.c
@@ -7,6 +7,7 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/mman.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -21,6 +22,8 @@
 
 char buf[BUFSZ];
 
+int countfree();
+
 // what if you pass ridiculous pointers to system calls
 // that read user memory with copyin?
 void
@@ -865,6 +868,53 @@ preempt(char *s)
   wait(0);
 }
 
+// a deadline class process that spins has to be throttled once
+// its budget runs out, rather than starve the other processes on
+// its cpu. if it isn't, this test never finishes.
+void
+dlstarve(char *s)
+{
+  int pid, t0;
+  int pfds[2];
+
+  // keep the parent on the child's cpu.
+  if(setaffinity(0, 1) < 0){
+    printf("%s: setaffinity failed\n", s);
+    exit(1);
+  }
+  pipe(pfds);
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(pfds[0]);
+    // half of cpu 0.
+    if(setdeadline(5000, 10000, 10000) < 0){
+      printf("%s: setdeadline failed\n", s);
+      exit(1);
+    }
+    write(pfds[1], "x", 1);
+    close(pfds[1]);
+    for(;;)
+      ;
+  }
+
+  close(pfds[1]);
+  if(read(pfds[0], buf, sizeof(buf)) != 1){
+    printf("%s: child was not admitted\n", s);
+    exit(1);
+  }
+  close(pfds[0]);
+  // spin too; this only gets anywhere in the child's off time.
+  t0 = uptime();
+  while(uptime() < t0 + 10)
+    ;
+  kill(pid);
+  wait(0);
+}
+
 // try to find any races between exit and wait
 void
 exitwait(char *s)
@@ -2041,12 +2091,14 @@ iref(char *s)
 }
 
 // test that fork fails gracefully
-// the forktest binary also does this, but it runs out of proc entries first.
-// inside the bigger usertests binary, we run out of memory first.
+// the forktest binary also does this, and may run out of proc entries first.
+// inside the bigger usertests binary, we likely run out of memory first.
+// either way fork must fail before NPROC children, since init, the shell
+// and usertests hold entries too.
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = NPROC };
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -2063,7 +2115,7 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work %d times!\n", s, N);
     exit(1);
   }
 
@@ -2617,6 +2669,49 @@ sbrk8000(char *s)
   *(top-1) = *(top-1) + 1;
 }
 
+// does sbrk refuse to grow the address space past the top,
+// instead of wrapping the size around below pages that are
+// already in use? if it wraps, the kernel panics in freewalk
+// when the process exits.
+void
+sbrkwrap(char *s)
+{
+  char *a, *top;
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    top = sbrk(0);
+    *(top-1) = 1;
+    // nor shrink below zero.
+    if(sbrk(-0x7fffffff) != (char*)0xffffffffffffffffL){
+      printf("%s: sbrk shrank below zero\n", s);
+      exit(1);
+    }
+    for(int i = 0; i < 1024; i++){
+      a = sbrk(0x7fffffff);
+      if(a == (char*)0xffffffffffffffffL)
+        break;
+      if(a < top){
+        printf("%s: sbrk wrapped to %p\n", s, a);
+        exit(1);
+      }
+      top = a;
+    }
+    if(sbrk(0x7fffffff) != (char*)0xffffffffffffffffL){
+      printf("%s: sbrk never failed\n", s);
+      exit(1);
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  exit(xstatus);
+}
+
 // regression test. does write() with an invalid buffer pointer cause
 // a block to be allocated for a file that is then not freed when the
 // file is deleted? if the kernel has this bug, it will panic: balloc:
@@ -2749,102 +2844,994 @@ diskfull(char *s)
   }
 }
 
-//
-// use sbrk() to count how many free physical memory pages there are.
-// touches the pages to force allocation.
-// because out of memory with lazy allocation results in the process
-// taking a fault and being killed, fork and report back.
-//
-int
-countfree()
+// do a parent and a child of fork() each see only their own
+// stores to the memory they share copy-on-write?
+void
+cowfork(char *s)
 {
-  int fds[2];
+  char *a;
+  int pid, xstatus;
 
-  if(pipe(fds) < 0){
-    printf("pipe() failed in countfree()\n");
+  a = sbrk(2*PGSIZE);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
     exit(1);
   }
-  
-  int pid = fork();
+  memset(a, 'p', 2*PGSIZE);
 
+  pid = fork();
   if(pid < 0){
-    printf("fork failed in countfree()\n");
+    printf("%s: fork failed\n", s);
     exit(1);
   }
-
   if(pid == 0){
-    close(fds[0]);
-    
-    while(1){
-      uint64 a = (uint64) sbrk(4096);
-      if(a == 0xffffffffffffffff){
-        break;
-      }
+    a[0] = 'c';
+    // give the parent time to store into the second page.
+    sleep(1);
+    if(a[PGSIZE] != 'p'){
+      printf("%s: parent's store seen by the child\n", s);
+      exit(1);
+    }
+    exit(0);
+  }
+  a[PGSIZE] = 'P';
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  if(a[0] != 'p' || a[PGSIZE] != 'P'){
+    printf("%s: child's store seen by the parent\n", s);
+    exit(1);
+  }
+}
 
-      // modify the memory to make sure it's really allocated.
-      *(char *)(a + 4096 - 1) = 1;
+// does a read() into a page shared copy-on-write give the reader
+// its own copy, rather than writing into the shared page? the
+// kernel writes user memory without taking a page fault.
+void
+cowread(char *s)
+{
+  char *file = "cowread";
+  char *a, c;
+  int fds[2], fd, pid, xstatus;
 
-      // report back one more page.
-      if(write(fds[1], "x", 1) != 1){
-        printf("write() failed in countfree()\n");
-        exit(1);
-      }
-    }
+  a = sbrk(PGSIZE);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  memset(a, 'p', PGSIZE);
 
+  // the child reads from a pipe into the shared page.
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[1]);
+    if(read(fds[0], a, 10) != 10 || a[0] != 'x' || a[10] != 'p'){
+      printf("%s: read into a copy-on-write page failed\n", s);
+      exit(1);
+    }
     exit(0);
   }
-
+  close(fds[0]);
+  if(write(fds[1], "xxxxxxxxxx", 10) != 10){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
   close(fds[1]);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  if(a[0] != 'p'){
+    printf("%s: child's read() reached the parent's page\n", s);
+    exit(1);
+  }
 
-  int n = 0;
-  while(1){
-    char c;
-    int cc = read(fds[0], &c, 1);
-    if(cc < 0){
-      printf("read() failed in countfree()\n");
+  // the parent reads from a file into the shared page, and
+  // then lets the child look.
+  fd = open(file, O_CREATE|O_TRUNC|O_RDWR);
+  if(fd < 0 || write(fd, "ffffffffff", 10) != 10){
+    printf("%s: create %s failed\n", s, file);
+    exit(1);
+  }
+  close(fd);
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[1]);
+    if(read(fds[0], &c, 1) != 1){
+      printf("%s: read failed\n", s);
       exit(1);
     }
-    if(cc == 0)
-      break;
-    n += 1;
+    if(a[0] != 'p'){
+      printf("%s: parent's read() reached the child's page\n", s);
+      exit(1);
+    }
+    exit(0);
   }
-
   close(fds[0]);
-  wait((int*)0);
-  
-  return n;
+  fd = open(file, O_RDONLY);
+  if(fd < 0 || read(fd, a, 10) != 10 || a[0] != 'f'){
+    printf("%s: read into a copy-on-write page failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  write(fds[1], "x", 1);
+  close(fds[1]);
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  unlink(file);
 }
 
-// run each test in its own process. run returns 1 if child's exit()
-// indicates success.
-int
-run(void f(char *), char *s) {
-  int pid;
-  int xstatus;
+// are pages shared copy-on-write freed once the last process
+// sharing them is done with them? a process with a heap of a
+// quarter of free memory forks over and over, which only works
+// copy-on-write, and its children store into some of the pages.
+// no page may be lost once it has exited.
+void
+cowfree(char *s)
+{
+  int free0, free1, n, pid, xstatus;
+  char *a;
 
-  printf("test %s: ", s);
-  if((pid = fork()) < 0) {
-    printf("runtest: fork error\n");
+  free0 = countfree();
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
     exit(1);
   }
-  if(pid == 0) {
-    f(s);
+  if(pid == 0){
+    n = free0 / 4;
+    a = sbrk(n * PGSIZE);
+    if(a == (char*)0xffffffffffffffffL){
+      printf("%s: sbrk failed\n", s);
+      exit(1);
+    }
+    for(int i = 0; i < n; i++)
+      a[i * PGSIZE] = i;
+    for(int round = 0; round < 8; round++){
+      // the last rounds leave three children sharing at once.
+      int nkids = round < 6 ? 1 : 3;
+      for(int k = 0; k < nkids; k++){
+        pid = fork();
+        if(pid < 0){
+          printf("%s: fork %d failed\n", s, round);
+          exit(1);
+        }
+        if(pid == 0){
+          for(int i = round + k; i < n; i += 8)
+            a[i * PGSIZE] = ~i;
+          exit(0);
+        }
+      }
+      for(int k = 0; k < nkids; k++){
+        wait(&xstatus);
+        if(xstatus != 0)
+          exit(xstatus);
+      }
+    }
+    for(int i = 0; i < n; i++){
+      if(a[i * PGSIZE] != (char)i){
+        printf("%s: child's store seen by the parent\n", s);
+        exit(1);
+      }
+    }
     exit(0);
-  } else {
-    wait(&xstatus);
-    if(xstatus != 0) 
-      printf("FAILED\n");
-    else
-      printf("OK\n");
-    return xstatus == 0;
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  free1 = countfree();
+  if(free1 < free0){
+    printf("%s: lost %d free pages\n", s, free0 - free1);
+    exit(1);
   }
 }
 
+// make a file of npages pages, page i filled with 'a'+i,
+// and open it with mode.
 int
-main(int argc, char *argv[])
+mkpagefile(char *s, char *name, int npages, int mode)
 {
-  int continuous = 0;
-  char *justone = 0;
+  int fd;
+
+  fd = open(name, O_CREATE|O_TRUNC|O_WRONLY);
+  if(fd < 0){
+    printf("%s: create %s failed\n", s, name);
+    exit(1);
+  }
+  for(int i = 0; i < npages; i++){
+    memset(buf, 'a' + i, PGSIZE);
+    if(write(fd, buf, PGSIZE) != PGSIZE){
+      printf("%s: write %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  close(fd);
+  if((fd = open(name, mode)) < 0){
+    printf("%s: open %s failed\n", s, name);
+    exit(1);
+  }
+  return fd;
+}
+
+// does reading a, which should not be mapped, kill the process?
+void
+mustfault(char *s, char *a)
+{
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    printf("%s: oops could read %p = %x\n", s, a, *(volatile char *)a);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != -1)
+    exit(1);
+}
+
+// does an anonymous MAP_SHARED mapping stay shared with a child
+// of fork(), including pages neither process touched before the
+// fork? does an anonymous MAP_PRIVATE mapping stay private?
+void
+mmapanon(char *s)
+{
+  char *shared, *private;
+  int pid, xstatus;
+
+  // unknown protection bits and flags are refused.
+  if(mmap(0, PGSIZE, PROT_READ|0x80, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0) != (void*)-1 ||
+     mmap(0, PGSIZE, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS|0x1000, -1, 0) != (void*)-1){
+    printf("%s: mmap took bad prot or flags\n", s);
+    exit(1);
+  }
+
+  shared = mmap(0, 2*PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  private = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(shared == (char*)-1 || private == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  if(private[0] != 0){
+    printf("%s: anonymous memory not zeroed\n", s);
+    exit(1);
+  }
+  // only the first shared page is touched before the fork.
+  shared[0] = 'a';
+  private[0] = 'a';
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(shared[PGSIZE] != 0){
+      printf("%s: anonymous memory not zeroed\n", s);
+      exit(1);
+    }
+    shared[0] = 'b';
+    shared[PGSIZE+1] = 'b';
+    private[0] = 'b';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  if(shared[0] != 'b' || shared[PGSIZE+1] != 'b'){
+    printf("%s: child's store to a shared mapping lost\n", s);
+    exit(1);
+  }
+  if(private[0] != 'a'){
+    printf("%s: child's store to a private mapping seen\n", s);
+    exit(1);
+  }
+  if(munmap(shared, 2*PGSIZE) < 0 || munmap(private, PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+}
+
+// do stores to a MAP_SHARED mapping of a file reach the file when
+// it is unmapped, and when the process exits without unmapping it?
+void
+mmapshared(char *s)
+{
+  char *file = "mmapshared";
+  char *a;
+  int fd, pid, xstatus;
+
+  fd = mkpagefile(s, file, 1, O_RDWR);
+  a = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  // the mapping holds its own reference to the file.
+  close(fd);
+  if(a == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  a[0] = 'x';
+  a[PGSIZE-1] = 'x';
+  if(munmap(a, PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    fd = open(file, O_RDWR);
+    a = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if(a == (char*)-1){
+      printf("%s: mmap in child failed\n", s);
+      exit(1);
+    }
+    if(a[0] != 'x'){
+      printf("%s: mapping doesn't see the written back page\n", s);
+      exit(1);
+    }
+    a[1] = 'y';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+
+  fd = open(file, O_RDONLY);
+  if(fd < 0 || read(fd, buf, PGSIZE) != PGSIZE){
+    printf("%s: read %s failed\n", s, file);
+    exit(1);
+  }
+  close(fd);
+  if(buf[0] != 'x' || buf[PGSIZE-1] != 'x'){
+    printf("%s: stores not written back by munmap\n", s);
+    exit(1);
+  }
+  if(buf[1] != 'y'){
+    printf("%s: stores not written back by exit\n", s);
+    exit(1);
+  }
+  if(buf[2] != 'a'){
+    printf("%s: untouched byte changed\n", s);
+    exit(1);
+  }
+  unlink(file);
+}
+
+// are stores to a MAP_PRIVATE mapping of a file kept from the file,
+// from a MAP_SHARED mapping of it, and from a child of fork()?
+void
+mmapprivate(char *s)
+{
+  char *file = "mmapprivate";
+  char *a, *b;
+  int fd, pid, xstatus;
+
+  // a private mapping may be written through a read-only fd.
+  fd = mkpagefile(s, file, 1, O_RDONLY);
+  a = mmap(0, PGSIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  b = mmap(0, PGSIZE, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(a == (char*)-1 || b == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  a[0] = 'x';
+  if(b[0] != 'a'){
+    printf("%s: private store seen through a shared mapping\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(a[0] != 'x'){
+      printf("%s: child lost the parent's private store\n", s);
+      exit(1);
+    }
+    a[0] = 'y';
+    a[1] = 'y';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  if(a[0] != 'x' || a[1] != 'a'){
+    printf("%s: child's private store seen by the parent\n", s);
+    exit(1);
+  }
+  if(munmap(a, PGSIZE) < 0 || munmap(b, PGSIZE) < 0){
+    printf("%s: munmap failed\n", s);
+    exit(1);
+  }
+
+  fd = open(file, O_RDONLY);
+  if(fd < 0 || read(fd, buf, PGSIZE) != PGSIZE){
+    printf("%s: read %s failed\n", s, file);
+    exit(1);
+  }
+  close(fd);
+  if(buf[0] != 'a' || buf[1] != 'a'){
+    printf("%s: private store reached the file\n", s);
+    exit(1);
+  }
+  unlink(file);
+}
+
+// does munmap() of the middle of a mapping leave the two ends
+// mapped, to the right pages of the file, and the middle not?
+void
+munmapsplit(char *s)
+{
+  char *file = "munmapsplit";
+  char *a;
+  int fd;
+
+  fd = mkpagefile(s, file, 3, O_RDONLY);
+  a = mmap(0, 3*PGSIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(a == (char*)-1){
+    printf("%s: mmap failed\n", s);
+    exit(1);
+  }
+  if(munmap(a + PGSIZE, PGSIZE) < 0){
+    printf("%s: munmap of the middle failed\n", s);
+    exit(1);
+  }
+  if(a[0] != 'a' || a[2*PGSIZE] != 'c'){
+    printf("%s: ends of the split mapping are wrong: %c %c\n", s, a[0], a[2*PGSIZE]);
+    exit(1);
+  }
+  mustfault(s, a + PGSIZE);
+
+  // unmapping across the hole unmaps both ends.
+  if(munmap(a, 3*PGSIZE) < 0){
+    printf("%s: munmap across the hole failed\n", s);
+    exit(1);
+  }
+  mustfault(s, a);
+  mustfault(s, a + 2*PGSIZE);
+  unlink(file);
+}
+
+// does a large sbrk() only use memory for the pages that are
+// touched, and give it all back when the heap shrinks?
+void
+lazysparse(char *s)
+{
+  enum { BIG = 1024*1024*1024, STRIDE = 1024*PGSIZE };
+  int free0, free1, pid, xstatus;
+  char *a;
+
+  free0 = countfree();
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // more than all of memory, so it can only work lazily.
+    a = sbrk(BIG);
+    if(a == (char*)0xffffffffffffffffL){
+      printf("%s: sbrk(%d) failed\n", s, BIG);
+      exit(1);
+    }
+    for(int i = 0; i < BIG / STRIDE; i++){
+      if(a[i * STRIDE + 1] != 0){
+        printf("%s: untouched heap page not zero\n", s);
+        exit(1);
+      }
+      a[i * STRIDE] = i + 1;
+    }
+    for(int i = 0; i < BIG / STRIDE; i++){
+      if(a[i * STRIDE] != (char)(i + 1)){
+        printf("%s: heap store lost\n", s);
+        exit(1);
+      }
+    }
+    if(sbrk(-BIG) == (char*)0xffffffffffffffffL || sbrk(0) != a){
+      printf("%s: shrinking the heap failed\n", s);
+      exit(1);
+    }
+    mustfault(s, a + STRIDE);
+    // grown again, the pages are new.
+    if(sbrk(BIG) != a || a[STRIDE] != 0){
+      printf("%s: regrown heap page not zero\n", s);
+      exit(1);
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  free1 = countfree();
+  if(free1 < free0){
+    printf("%s: lost %d free pages\n", s, free0 - free1);
+    exit(1);
+  }
+}
+
+// can the kernel copy into and out of heap pages that were
+// never touched? it takes no page faults on user memory.
+void
+lazyread(char *s)
+{
+  char *a;
+  int fds[2];
+
+  a = sbrk(3*PGSIZE);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  // write() copies in from an untouched page ...
+  if(write(fds[1], a + 2*PGSIZE, 10) != 10){
+    printf("%s: write from an untouched page failed\n", s);
+    exit(1);
+  }
+  if(write(fds[1], "xxxxxxxxxx", 10) != 10){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  // ... and read() copies out across two of them.
+  if(read(fds[0], a + PGSIZE - 10, 20) != 20){
+    printf("%s: read into untouched pages failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < 10; i++){
+    if(a[PGSIZE - 10 + i] != 0 || a[PGSIZE + i] != 'x'){
+      printf("%s: read into untouched pages got the wrong data\n", s);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// does fork() copy a heap with holes in it, which stay holes
+// for both processes until each touches them?
+void
+lazyfork(char *s)
+{
+  enum { BIG = 64*1024*1024, STRIDE = 256*PGSIZE };
+  char *a;
+  int pid, xstatus;
+
+  a = sbrk(BIG);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(int i = 0; i < BIG; i += 2*STRIDE)
+    a[i] = 'p';
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(int i = 0; i < BIG; i += STRIDE){
+      if(a[i] != (i % (2*STRIDE) ? 0 : 'p')){
+        printf("%s: child's heap differs at %d\n", s, i);
+        exit(1);
+      }
+      a[i] = 'c';
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+  for(int i = 0; i < BIG; i += STRIDE){
+    if(a[i] != (i % (2*STRIDE) ? 0 : 'p')){
+      printf("%s: child's store seen by the parent at %d\n", s, i);
+      exit(1);
+    }
+  }
+  if(sbrk(-BIG) == (char*)0xffffffffffffffffL){
+    printf("%s: shrinking the heap failed\n", s);
+    exit(1);
+  }
+}
+
+// sbrk() can't fail for lack of memory any more, since it
+// allocates nothing. is a process that then touches more than
+// there is killed, and is all of its memory freed?
+void
+lazyoom(char *s)
+{
+  enum { TOOMUCH = 1024*1024*1024 };
+  int free0, free1, pid, xstatus;
+  char *a;
+
+  free0 = countfree();
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    a = sbrk(TOOMUCH);
+    if(a == (char*)0xffffffffffffffffL){
+      printf("%s: sbrk(%d) failed\n", s, TOOMUCH);
+      exit(1);
+    }
+    for(char *b = a; b < a + TOOMUCH; b += PGSIZE)
+      *b = 1;
+    printf("%s: touched more memory than there is\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: process out of memory not killed\n", s);
+    exit(1);
+  }
+  free1 = countfree();
+  if(free1 < free0){
+    printf("%s: lost %d free pages\n", s, free0 - free1);
+    exit(1);
+  }
+}
+
+// initialized data, which exec() leaves in the program's file
+// until it is touched.
+char progdata[2*PGSIZE] = "program data";
+
+// copy the file from to the file to.
+void
+copyfile(char *s, char *from, char *to)
+{
+  int fd0, fd1, n;
+
+  fd0 = open(from, O_RDONLY);
+  fd1 = open(to, O_CREATE|O_TRUNC|O_WRONLY);
+  if(fd0 < 0 || fd1 < 0){
+    printf("%s: copy %s to %s failed\n", s, from, to);
+    exit(1);
+  }
+  while((n = read(fd0, buf, sizeof(buf))) > 0){
+    if(write(fd1, buf, n) != n){
+      printf("%s: write %s failed\n", s, to);
+      exit(1);
+    }
+  }
+  close(fd0);
+  close(fd1);
+}
+
+// read exactly n bytes from fd, or fail.
+void
+readall(char *s, int fd, char *b, int n)
+{
+  int cc;
+
+  for(int i = 0; i < n; i += cc){
+    if((cc = read(fd, b + i, n - i)) <= 0){
+      printf("%s: short read\n", s);
+      exit(1);
+    }
+  }
+}
+
+// does a store to a program's data page stay with the process that
+// made it, so that the next exec() of the program starts with the
+// data in its file? the data pages of a program are shared
+// copy-on-write through the page cache. main() checks progdata in
+// the new image.
+void
+execdata(char *s)
+{
+  char *args[] = { "execdata", 0 };
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    progdata[0] = 'X';
+    exec("usertests", args);
+    printf("%s: exec usertests failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: new image saw the old image's store\n", s);
+    exit(1);
+  }
+  if(strcmp(progdata, "program data") != 0){
+    printf("%s: child's store seen by the parent\n", s);
+    exit(1);
+  }
+}
+
+// does a program keep running while its file is rewritten, and
+// does the next exec() of the file run what was written, not pages
+// of the old program left in the page cache?
+void
+execrewrite(char *s)
+{
+  char *file = "execrewrite";
+  char *catargs[] = { file, 0 };
+  char *echoargs[] = { file, "hello", 0 };
+  int in[2], out[2], pid, xstatus;
+  char b[8];
+
+  // a copy of cat, which waits on its input.
+  copyfile(s, "cat", file);
+  if(pipe(in) < 0 || pipe(out) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(0);
+    dup(in[0]);
+    close(1);
+    dup(out[1]);
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+    exec(file, catargs);
+    exit(1);
+  }
+  close(in[0]);
+  close(out[1]);
+  write(in[1], "one\n", 4);
+  readall(s, out[0], b, 4);
+  if(memcmp(b, "one\n", 4) != 0){
+    printf("%s: copy of cat misbehaved\n", s);
+    exit(1);
+  }
+  // the same bytes, written while it runs, drop the cached pages
+  // it has mapped.
+  copyfile(s, "cat", file);
+  write(in[1], "two\n", 4);
+  readall(s, out[0], b, 4);
+  if(memcmp(b, "two\n", 4) != 0){
+    printf("%s: cat misbehaved once its file was rewritten\n", s);
+    exit(1);
+  }
+  close(in[1]);
+  if(read(out[0], b, 1) != 0){
+    printf("%s: cat wrote too much\n", s);
+    exit(1);
+  }
+  close(out[0]);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: cat failed once its file was rewritten\n", s);
+    exit(1);
+  }
+
+  // now it is echo.
+  copyfile(s, "echo", file);
+  if(pipe(out) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(1);
+    dup(out[1]);
+    close(out[0]);
+    close(out[1]);
+    exec(file, echoargs);
+    exit(1);
+  }
+  close(out[1]);
+  readall(s, out[0], b, 6);
+  if(memcmp(b, "hello\n", 6) != 0){
+    printf("%s: exec ran the old program\n", s);
+    exit(1);
+  }
+  close(out[0]);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: exec ran the old program\n", s);
+    exit(1);
+  }
+  unlink(file);
+}
+
+// can read() copy into a page of the program's data that hasn't
+// been read in from its file yet? a pipe read copies holding the
+// pipe's lock, and a file read holding the file's inode lock, so
+// the kernel must read the page in before it takes either.
+void
+execbuf(char *s)
+{
+  char *file = "execbuf";
+  // a page that holds nothing but progdata.
+  char *a = (char*)PGROUNDUP((uint64)progdata + 1);
+  int fds[2], fd, pid, xstatus;
+
+  fd = open(file, O_CREATE|O_TRUNC|O_RDWR);
+  if(fd < 0 || write(fd, "from a file", 12) != 12){
+    printf("%s: create %s failed\n", s, file);
+    exit(1);
+  }
+  close(fd);
+
+  // a child that hasn't touched the page either reads the file.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    fd = open(file, O_RDONLY);
+    if(fd < 0 || read(fd, a + 100, 12) != 12 || strcmp(a + 100, "from a file") != 0){
+      printf("%s: read from a file into program data failed\n", s);
+      exit(1);
+    }
+    if(a[99] != 0 || a[112] != 0){
+      printf("%s: program data around the read changed\n", s);
+      exit(1);
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(xstatus);
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  write(fds[1], "from a pipe", 12);
+  if(read(fds[0], a + 100, 12) != 12 || strcmp(a + 100, "from a pipe") != 0){
+    printf("%s: read from a pipe into program data failed\n", s);
+    exit(1);
+  }
+  if(a[99] != 0 || a[112] != 0 || strcmp(progdata, "program data") != 0){
+    printf("%s: program data around the read changed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  unlink(file);
+}
+
+//
+// use sbrk() to count how many free physical memory pages there are.
+// touches the pages to force allocation.
+// because out of memory with lazy allocation results in the process
+// taking a fault and being killed, fork and report back.
+//
+int
+countfree()
+{
+  int fds[2];
+
+  if(pipe(fds) < 0){
+    printf("pipe() failed in countfree()\n");
+    exit(1);
+  }
+  
+  int pid = fork();
+
+  if(pid < 0){
+    printf("fork failed in countfree()\n");
+    exit(1);
+  }
+
+  if(pid == 0){
+    close(fds[0]);
+    
+    while(1){
+      uint64 a = (uint64) sbrk(4096);
+      if(a == 0xffffffffffffffff){
+        break;
+      }
+
+      // modify the memory to make sure it's really allocated.
+      *(char *)(a + 4096 - 1) = 1;
+
+      // report back one more page.
+      if(write(fds[1], "x", 1) != 1){
+        printf("write() failed in countfree()\n");
+        exit(1);
+      }
+    }
+
+    exit(0);
+  }
+
+  close(fds[1]);
+
+  int n = 0;
+  while(1){
+    char c;
+    int cc = read(fds[0], &c, 1);
+    if(cc < 0){
+      printf("read() failed in countfree()\n");
+      exit(1);
+    }
+    if(cc == 0)
+      break;
+    n += 1;
+  }
+
+  close(fds[0]);
+  wait((int*)0);
+  
+  return n;
+}
+
+// run each test in its own process. run returns 1 if child's exit()
+// indicates success.
+int
+run(void f(char *), char *s) {
+  int pid;
+  int xstatus;
+
+  printf("test %s: ", s);
+  if((pid = fork()) < 0) {
+    printf("runtest: fork error\n");
+    exit(1);
+  }
+  if(pid == 0) {
+    f(s);
+    exit(0);
+  } else {
+    wait(&xstatus);
+    if(xstatus != 0) 
+      printf("FAILED\n");
+    else
+      printf("OK\n");
+    return xstatus == 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int continuous = 0;
+  char *justone = 0;
+
+  // the new image that execdata() exec()s.
+  if(argc == 1 && strcmp(argv[0], "execdata") == 0)
+    exit(strcmp(progdata, "program data") != 0);
 
   if(argc == 2 && strcmp(argv[1], "-c") == 0){
     continuous = 1;
@@ -2893,6 +3880,9 @@ main(int argc, char *argv[])
     {sharedfd, "sharedfd"},
     {dirtest, "dirtest"},
     {exectest, "exectest"},
+    {execdata, "execdata"},
+    {execrewrite, "execrewrite"},
+    {execbuf, "execbuf"},
     {bigargtest, "bigargtest"},
     {bigwrite, "bigwrite"},
     {bsstest, "bsstest"},
@@ -2903,6 +3893,11 @@ main(int argc, char *argv[])
     {sbrkarg, "sbrkarg"},
     {sbrklast, "sbrklast"},
     {sbrk8000, "sbrk8000"},
+    {sbrkwrap, "sbrkwrap"},
+    {lazysparse, "lazysparse"},
+    {lazyread, "lazyread"},
+    {lazyfork, "lazyfork"},
+    {lazyoom, "lazyoom"},
     {validatetest, "validatetest"},
     {stacktest, "stacktest"},
     {opentest, "opentest"},
@@ -2916,6 +3911,7 @@ main(int argc, char *argv[])
     {pipe1, "pipe1"},
     {killstatus, "killstatus"},
     {preempt, "preempt"},
+    {dlstarve, "dlstarve"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
     {fourteen, "fourteen"},
@@ -2923,6 +3919,13 @@ main(int argc, char *argv[])
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
+    {cowfork, "cowfork"},
+    {cowread, "cowread"},
+    {cowfree, "cowfree"},
+    {mmapanon, "mmapanon"},
+    {mmapshared, "mmapshared"},
+    {mmapprivate, "mmapprivate"},
+    {munmapsplit, "munmapsplit"},
     {MAXVAplus, "MAXVAplus"},
     {bigdir, "bigdir"}, // slow
     { 0, 0},
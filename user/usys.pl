@@ -39,3 +39,21 @@ entry("uptime");
 entry("startlog");
 entry("getlog");
 entry("nice");
+entry("getlat");
+entry("sched_getparam");
+entry("sched_setparam");
+entry("setclass");
+entry("setdeadline");
+entry("setaffinity");
+entry("getaffinity");
+entry("mkgroup");
+entry("rmgroup");
+entry("setgroup");
+entry("getgroup");
+entry("wait2");
+entry("getrusage");
+entry("setgang");
+entry("getlockstat");
+entry("lockbench");
+entry("mmap");
+entry("munmap");
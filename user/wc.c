@@ -1,8 +1,10 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/mman.h"
 #include "user/user.h"
 
 char buf[512];
+int l, w, c, inword, v;
 
 /**
  * 
@@ -36,29 +38,46 @@ int isVowel(char c)
   }
 }
 
+void
+count(char *p, int n)
+{
+  int i;
+
+  for(i=0; i<n; i++){
+    c++;
+    if(p[i] == '\n')
+      l++;
+    if (isVowel(p[i]))
+      v++;
+    if(strchr(" \r\t\n\v", p[i]))
+      inword = 0;
+    else if(!inword){
+      w++;
+      inword = 1;
+    }
+  }
+}
+
 void
 wc(int fd, char *name)
 {
-  int i, n;
-  int l, w, c, inword, v;
+  int n;
+  struct stat st;
+  char *p;
 
   l = w = c = v = 0;
   inword = 0;
-  while((n = read(fd, buf, sizeof(buf))) > 0){
-    for(i=0; i<n; i++){
-      c++;
-      if(buf[i] == '\n')
-        l++;
-      if (isVowel(buf[i]))
-        v++;
-      if(strchr(" \r\t\n\v", buf[i]))
-        inword = 0;
-      else if(!inword){
-        w++;
-        inword = 1;
-      }
-    }
+  // scan a regular file where it sits in the page cache,
+  // rather than copying it out with read().
+  if(fstat(fd, &st) == 0 && st.type == T_FILE && st.size > 0 &&
+     (p = mmap(0, st.size, PROT_READ, MAP_PRIVATE, fd, 0)) != (char*)-1){
+    count(p, st.size);
+    munmap(p, st.size);
+    printf("%d %d %d %d %s\n", l, w, c, v, name);
+    return;
   }
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    count(buf, n);
   if(n < 0){
     printf("wc: read error\n");
     exit(1);